@@ -23,35 +23,299 @@
 ///////////////////////////////////////////////////////////////////////////////////////
 
 #include <string.h>
+#include <wchar.h>
+#include <limits.h>
 #include <algorithm>
 #include <iterator>
 #include <locale>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <chrono>
+#include <limits>
+#include <type_traits>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <locale.h>
+#include <cmath>
 #include "stringutils.h"
 
+// Define CX_NO_SIMD to build the portable scalar code paths only.
+#if !defined(CX_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define CX_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(CX_SSE2) && defined(__AVX2__)
+#define CX_AVX2 1
+#include <immintrin.h>
+#endif
+
+// 32-bit wchar_t code units get their own kernels; 16-bit wchar_t uses the generic paths.
+#if defined(CX_SSE2) && WCHAR_MAX > 0xFFFF
+#define CX_WIDE_SIMD 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <langinfo.h>
+#endif
+
 namespace cx {
 	//////////////////////////////////////////////////////////////////////////
 #define CX_TRIM_CHARS "\t\n\v\f\r "
 #define CX_WTRIM_CHARS L"\t\n\v\f\r "
 
-	static std::string CxTrimChars = CX_TRIM_CHARS;
-	static std::wstring CxWTrimChars = CX_WTRIM_CHARS;
+	//////////////////////////////////////////////////////////////////////////
+	// Index of the lowest set bit, x must not be zero.
+	static inline unsigned int BitScan64(unsigned long long x) {
+#if defined(_MSC_VER)
+		unsigned long i;
+#if defined(_M_X64) || defined(_M_ARM64)
+		_BitScanForward64(&i, x);
+#else
+		if ((unsigned long)x != 0) _BitScanForward(&i, (unsigned long)x);
+		else { _BitScanForward(&i, (unsigned long)(x >> 32)); i += 32; }
+#endif
+		return (unsigned int)i;
+#else
+		return (unsigned int)__builtin_ctzll(x);
+#endif
+	}
+
+	// Index of the highest set bit, x must not be zero.
+	static inline unsigned int BitScanReverse64(unsigned long long x) {
+#if defined(_MSC_VER)
+		unsigned long i;
+#if defined(_M_X64) || defined(_M_ARM64)
+		_BitScanReverse64(&i, x);
+#else
+		if ((unsigned long)(x >> 32) != 0) { _BitScanReverse(&i, (unsigned long)(x >> 32)); i += 32; }
+		else _BitScanReverse(&i, (unsigned long)x);
+#endif
+		return (unsigned int)i;
+#else
+		return 63 - (unsigned int)__builtin_clzll(x);
+#endif
+	}
+
+	// The decimal point snprintf and strtod use on this thread. localeconv() fills a buffer shared by
+	// all threads, so POSIX systems read the locale data through nl_langinfo_l() instead.
+	static inline const char* CDecimalPoint() {
+#if defined(_MSC_VER)
+		return localeconv()->decimal_point;	// per-thread data in the MSVC runtime
+#else
+		locale_t loc = uselocale((locale_t)0);
+		return loc == LC_GLOBAL_LOCALE ? nl_langinfo(RADIXCHAR) : nl_langinfo_l(RADIXCHAR, loc);
+#endif
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Kernels over 32-bit wchar_t code units, 8 per vector with AVX2 and 4 with SSE2.
+#if defined(CX_WIDE_SIMD)
+	struct WideVec {
+#if defined(CX_AVX2)
+		typedef __m256i T;
+		enum { N = 8, Full = 0xFF };
+		static T load(const wchar_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+		static void store(wchar_t* p, T v) { _mm256_storeu_si256((__m256i*)p, v); }
+		static T set1(int x) { return _mm256_set1_epi32(x); }
+		static T eq(T a, T b) { return _mm256_cmpeq_epi32(a, b); }
+		static T gt(T a, T b) { return _mm256_cmpgt_epi32(a, b); }
+		static T or_(T a, T b) { return _mm256_or_si256(a, b); }
+		static T and_(T a, T b) { return _mm256_and_si256(a, b); }
+		static T xor_(T a, T b) { return _mm256_xor_si256(a, b); }
+		static T add(T a, T b) { return _mm256_add_epi32(a, b); }
+		static T sub(T a, T b) { return _mm256_sub_epi32(a, b); }
+		static unsigned int mask(T v) { return (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(v)); }
+#else
+		typedef __m128i T;
+		enum { N = 4, Full = 0xF };
+		static T load(const wchar_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+		static void store(wchar_t* p, T v) { _mm_storeu_si128((__m128i*)p, v); }
+		static T set1(int x) { return _mm_set1_epi32(x); }
+		static T eq(T a, T b) { return _mm_cmpeq_epi32(a, b); }
+		static T gt(T a, T b) { return _mm_cmpgt_epi32(a, b); }
+		static T or_(T a, T b) { return _mm_or_si128(a, b); }
+		static T and_(T a, T b) { return _mm_and_si128(a, b); }
+		static T xor_(T a, T b) { return _mm_xor_si128(a, b); }
+		static T add(T a, T b) { return _mm_add_epi32(a, b); }
+		static T sub(T a, T b) { return _mm_sub_epi32(a, b); }
+		static unsigned int mask(T v) { return (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(v)); }
+#endif
+
+		// Lanes outside [0, 0x7F], wchar_t being signed on some targets.
+		static T non_ascii(T v) { return or_(gt(v, set1(0x7F)), gt(set1(0), v)); }
+
+		// Lanes holding one of the default trim characters, as the unsigned test (u - 9) <= 4 or u == 32.
+		static T space(T v) {
+			T t = xor_(sub(v, set1(9)), set1(INT_MIN));
+			return or_(gt(set1(INT_MIN + 5), t), eq(v, set1(' ')));
+		}
+
+		// Adds delta to the lanes in [lo, hi] of an all-ASCII vector.
+		static T fold(T v, int lo, int hi, int delta) {
+			T in = and_(gt(v, set1(lo - 1)), gt(set1(hi + 1), v));
+			return add(v, and_(in, set1(delta)));
+		}
+	};
+#endif
+
+	static bool WideIEqualsScalar(const wchar_t* a, const wchar_t* b, size_t n, const CaseContext& ctx) {
+		for (size_t i = 0; i < n; i++) {
+			if (a[i] != b[i] && ctx.to_upper(a[i]) != ctx.to_upper(b[i])) return false;
+		}
+		return true;
+	}
+
+	// Length of the leading run of default trim characters.
+	static size_t WideSkipSpace(const wchar_t* p, size_t n) {
+		size_t i = 0;
+#if defined(CX_WIDE_SIMD)
+		for (; i + WideVec::N <= n; i += WideVec::N) {
+			unsigned int m = WideVec::mask(WideVec::space(WideVec::load(p + i))) ^ WideVec::Full;
+			if (m) return i + BitScan64(m);
+		}
+#endif
+		while (i < n && SpaceChars::contains(p[i])) i++;
+		return i;
+	}
+
+	// Length left after dropping the trailing run of default trim characters.
+	static size_t WideSkipSpaceBack(const wchar_t* p, size_t n) {
+#if defined(CX_WIDE_SIMD)
+		for (; n >= WideVec::N; n -= WideVec::N) {
+			unsigned int m = WideVec::mask(WideVec::space(WideVec::load(p + n - WideVec::N))) ^ WideVec::Full;
+			if (m) {
+				unsigned int k = WideVec::N - 1;
+				while (!(m >> k & 1)) k--;
+				return n - WideVec::N + k + 1;
+			}
+		}
+#endif
+		while (n > 0 && SpaceChars::contains(p[n - 1])) n--;
+		return n;
+	}
+
+	// Converts in place; all-ASCII blocks fold with vector adds when the context allows it.
+	static void WideFoldCase(wchar_t* p, size_t n, bool upper, const CaseContext& ctx) {
+		size_t i = 0;
+#if defined(CX_WIDE_SIMD)
+		if (ctx.wide_ascii_simple()) {
+			int lo = upper ? 'a' : 'A', delta = upper ? -32 : 32;
+			for (; i + WideVec::N <= n; i += WideVec::N) {
+				WideVec::T v = WideVec::load(p + i);
+				if (WideVec::mask(WideVec::non_ascii(v)) == 0) {
+					WideVec::store(p + i, WideVec::fold(v, lo, lo + 25, delta));
+					continue;
+				}
+				for (size_t j = i; j < i + WideVec::N; j++)
+					p[j] = upper ? ctx.to_upper(p[j]) : ctx.to_lower(p[j]);
+			}
+		}
+#endif
+		for (; i < n; i++)
+			p[i] = upper ? ctx.to_upper(p[i]) : ctx.to_lower(p[i]);
+	}
+
+	// Case-insensitive equality of n units, as to_upper(a[i]) == to_upper(b[i]).
+	static bool WideIEquals(const wchar_t* a, const wchar_t* b, size_t n, const CaseContext& ctx) {
+		size_t i = 0;
+#if defined(CX_WIDE_SIMD)
+		if (ctx.wide_ascii_simple()) {
+			for (; i + WideVec::N <= n; i += WideVec::N) {
+				WideVec::T va = WideVec::load(a + i), vb = WideVec::load(b + i);
+				if (WideVec::mask(WideVec::eq(va, vb)) == WideVec::Full) continue;
+				if (WideVec::mask(WideVec::or_(WideVec::non_ascii(va), WideVec::non_ascii(vb))) == 0) {
+					va = WideVec::fold(va, 'A', 'Z', 32);
+					vb = WideVec::fold(vb, 'A', 'Z', 32);
+					if (WideVec::mask(WideVec::eq(va, vb)) != WideVec::Full) return false;
+				}
+				else if (!WideIEqualsScalar(a + i, b + i, WideVec::N, ctx)) {
+					return false;
+				}
+			}
+		}
+#endif
+		return WideIEqualsScalar(a + i, b + i, n - i, ctx);
+	}
+
+	// Position of needle in [pos, n) of the haystack, or -1; candidates come from a vector scan for the first unit.
+	static size_t WideFind(const wchar_t* h, size_t n, const wchar_t* needle, size_t len, size_t pos, bool ignoreCase, const CaseContext& ctx) {
+		if (pos > n || len > n - pos) return (size_t)-1;
+		if (len == 0) return pos;
+
+		size_t last = n - len, i = pos;
+#if defined(CX_WIDE_SIMD)
+		wchar_t c = needle[0];
+		bool ascii = c >= 0 && c < 0x80;
+		if (!ignoreCase || (ascii && ctx.wide_ascii_simple())) {
+			// Folding candidates also keep every non-ASCII lane, which may fold to an ASCII letter.
+			bool fold = ignoreCase && ctx.to_lower(c) != ctx.to_upper(c);
+			WideVec::T lower = WideVec::set1(fold ? ctx.to_lower(c) : c), upper = WideVec::set1(fold ? ctx.to_upper(c) : c);
+			for (; i + WideVec::N <= last + 1; i += WideVec::N) {
+				WideVec::T v = WideVec::load(h + i);
+				WideVec::T hit = WideVec::or_(WideVec::eq(v, lower), WideVec::eq(v, upper));
+				if (ignoreCase) hit = WideVec::or_(hit, WideVec::non_ascii(v));
+				for (unsigned int m = WideVec::mask(hit); m; m &= m - 1) {
+					size_t k = i + BitScan64(m);
+					if (ignoreCase ? WideIEquals(h + k, needle, len, ctx) : wmemcmp(h + k, needle, len) == 0) return k;
+				}
+			}
+		}
+#endif
+		for (; i <= last; i++) {
+			if (ignoreCase ? WideIEquals(h + i, needle, len, ctx) : wmemcmp(h + i, needle, len) == 0) return i;
+		}
+		return (size_t)-1;
+	}
+
+	// Index of the first unit that is in set, or n; sets of up to four units are scanned with vector compares.
+	static size_t WideFindAny(const wchar_t* p, size_t n, const wchar_t* set, size_t setLen) {
+		if (setLen == 0) return n;
+
+		size_t i = 0;
+#if defined(CX_WIDE_SIMD)
+		if (setLen <= 4) {
+			WideVec::T s0 = WideVec::set1(set[0]), s1 = WideVec::set1(set[setLen > 1 ? 1 : 0]);
+			WideVec::T s2 = WideVec::set1(set[setLen > 2 ? 2 : 0]), s3 = WideVec::set1(set[setLen > 3 ? 3 : 0]);
+			for (; i + WideVec::N <= n; i += WideVec::N) {
+				WideVec::T v = WideVec::load(p + i);
+				WideVec::T hit = WideVec::or_(WideVec::or_(WideVec::eq(v, s0), WideVec::eq(v, s1)),
+					WideVec::or_(WideVec::eq(v, s2), WideVec::eq(v, s3)));
+				unsigned int m = WideVec::mask(hit);
+				if (m) return i + BitScan64(m);
+			}
+		}
+#endif
+		for (; i < n; i++) {
+			if (wmemchr(set, p[i], setLen)) return i;
+		}
+		return n;
+	}
+
 
 	class StringTrimHelper {
 	public:
-		template<typename TStr>
-		static void trim(TStr& src, const TStr& chars) {
+		template<typename TStr, typename TChars>
+		static void trim(TStr& src, const TChars& chars) {
 			trim_start(src, chars);
 			trim_end(src, chars);
 		}
 
-		template<typename TStr>
-		static void trim_copy(const TStr& src, TStr& dst, const TStr& chars) {
+		template<typename TStr, typename TChars>
+		static void trim_copy(const TStr& src, TStr& dst, const TChars& chars) {
 			dst = src;
 			trim(dst, chars);
 		}
 
-		template<typename TStr>
-		static TStr trim_copy(const TStr& src, const TStr& chars) {
+		template<typename TStr, typename TChars>
+		static TStr trim_copy(const TStr& src, const TChars& chars) {
 			TStr dst;
 			trim_copy(src, dst, chars);
 			return dst;
@@ -62,14 +326,23 @@ namespace cx {
 			src.erase(0, src.find_first_not_of(chars));
 		}
 
-		template<typename TStr>
-		static void trim_start_copy(const TStr& src, TStr& dst, const TStr& chars) {
+		template<typename TStr, char... Cs>
+		static void trim_start(TStr& src, const CharSet<Cs...>&) {
+			CharSet<Cs...>::trim_start(src);
+		}
+
+		static void trim_start(std::wstring& src, const SpaceChars&) {
+			src.erase(0, WideSkipSpace(src.data(), src.size()));
+		}
+
+		template<typename TStr, typename TChars>
+		static void trim_start_copy(const TStr& src, TStr& dst, const TChars& chars) {
 			dst = src;
 			trim_start(dst, chars);
 		}
 
-		template<typename TStr>
-		static TStr trim_start_copy(const TStr& src, const TStr& chars) {
+		template<typename TStr, typename TChars>
+		static TStr trim_start_copy(const TStr& src, const TChars& chars) {
 			TStr dst;
 			trim_start_copy(src, dst, chars);
 			return dst;
@@ -80,20 +353,175 @@ namespace cx {
 			src.erase(src.find_last_not_of(chars) + 1);
 		}
 
-		template<typename TStr>
-		static void trim_end_copy(const TStr& src, TStr& dst, const TStr& chars) {
+		template<typename TStr, char... Cs>
+		static void trim_end(TStr& src, const CharSet<Cs...>&) {
+			CharSet<Cs...>::trim_end(src);
+		}
+
+		static void trim_end(std::wstring& src, const SpaceChars&) {
+			src.erase(WideSkipSpaceBack(src.data(), src.size()));
+		}
+
+		template<typename TStr, typename TChars>
+		static void trim_end_copy(const TStr& src, TStr& dst, const TChars& chars) {
 			dst = src;
 			trim_end(dst, chars);
 		}
 
-		template<typename TStr>
-		static TStr trim_end_copy(const TStr& src, const TStr& chars) {
+		template<typename TStr, typename TChars>
+		static TStr trim_end_copy(const TStr& src, const TChars& chars) {
 			TStr dst;
 			trim_end_copy(src, dst, chars);
 			return dst;
 		}
 	};
 
+	// Trims and collapses white-space runs into one space, compacting in place.
+	template<typename TChar>
+	class SpaceNormalizeHelper {
+	public:
+		explicit SpaceNormalizeHelper(const std::basic_string<TChar>& chars) : _Chars(chars), _Simd(false) {
+			memset(_Table, 0, sizeof(_Table));
+			for (size_t i = 0; i < chars.size(); i++) {
+				if (code(chars[i]) < 256) _Table[code(chars[i])] = true;
+			}
+#if defined(CX_SSE2)
+			_Simd = sizeof(TChar) == 1 && !chars.empty() && chars.size() <= 8;
+#endif
+		}
+
+		void run(std::basic_string<TChar>& s) const {
+			size_t n = s.size(), r = 0, w = 0;
+			if (n == 0) return;
+
+			TChar* p = &s[0];
+			bool gap = false;
+			while (r < n) {
+				if (n - r >= 16 && clean_block(p + r)) {
+					if (gap) {
+						p[w++] = ' ';
+						gap = false;
+					}
+					if (w != r) memmove(p + w, p + r, 16 * sizeof(TChar));
+					w += 16;
+					r += 16;
+					continue;
+				}
+
+				for (size_t end = std::min(n, r + 16); r < end; r++) {
+					TChar c = p[r];
+					if (is_space(c)) {
+						gap = w > 0;
+						continue;
+					}
+					if (gap) {
+						p[w++] = ' ';
+						gap = false;
+					}
+					p[w++] = c;
+				}
+			}
+			s.resize(w);
+		}
+
+	private:
+		static size_t code(char c) { return (unsigned char)c; }
+		static size_t code(wchar_t c) { return (size_t)(unsigned int)c; }
+
+		bool is_space(TChar c) const {
+			size_t u = code(c);
+			return u < 256 ? _Table[u] : _Chars.find(c) != std::basic_string<TChar>::npos;
+		}
+
+		// A block needs no rewriting if its only white-space is single ' ' strictly inside it.
+		bool clean_block(const wchar_t*) const { return false; }
+
+		bool clean_block(const char* p) const {
+#if defined(CX_SSE2)
+			if (!_Simd) return false;
+
+			__m128i v = _mm_loadu_si128((const __m128i*)p);
+			__m128i ws = _mm_setzero_si128();
+			for (size_t i = 0; i < _Chars.size(); i++)
+				ws = _mm_or_si128(ws, _mm_cmpeq_epi8(v, _mm_set1_epi8(_Chars[i])));
+
+			unsigned int m = (unsigned int)_mm_movemask_epi8(ws);
+			if (m == 0) return true;
+
+			unsigned int sp = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+			return (m & ~sp) == 0 && (m & (m >> 1)) == 0 && (m & 0x8001) == 0;
+#else
+			(void)p;
+			return false;
+#endif
+		}
+
+		std::basic_string<TChar> _Chars;
+		bool _Table[256];
+		bool _Simd;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	CaseContext::CaseContext()
+	{
+		init();
+	}
+
+	CaseContext::CaseContext(const std::locale& loc) : _Loc(loc)
+	{
+		init();
+	}
+
+	// Constant-initialized, so global() is a single load even during static initialization.
+	static std::atomic<const CaseContext*> CurrentCaseContext(NULL);
+
+	const CaseContext& CaseContext::global()
+	{
+		const CaseContext* ctx = CurrentCaseContext.load(std::memory_order_acquire);
+		return ctx != NULL ? *ctx : refresh_global();
+	}
+
+	const CaseContext& CaseContext::refresh_global()
+	{
+		// References handed out by global() must stay valid, so replaced contexts are kept until
+		// exit; one is built per distinct locale and reused when that locale comes back.
+		static std::mutex lock;
+		static std::vector<std::unique_ptr<CaseContext> > built;
+
+		std::locale loc;
+		std::lock_guard<std::mutex> guard(lock);
+		const CaseContext* ctx = NULL;
+		for (size_t i = 0; i < built.size() && ctx == NULL; i++) {
+			if (built[i]->_Loc == loc) ctx = built[i].get();
+		}
+		if (ctx == NULL) {
+			built.push_back(std::unique_ptr<CaseContext>(new CaseContext(loc)));
+			ctx = built.back().get();
+		}
+		CurrentCaseContext.store(ctx, std::memory_order_release);
+		return *ctx;
+	}
+
+	void CaseContext::init()
+	{
+		const std::ctype<char>& ct = std::use_facet<std::ctype<char> >(_Loc);
+		_WCType = &std::use_facet<std::ctype<wchar_t> >(_Loc);
+
+		for (int i = 0; i < 256; i++) {
+			_Lower[i] = (unsigned char)ct.tolower((char)i);
+			_Upper[i] = (unsigned char)ct.toupper((char)i);
+		}
+
+		_WAsciiSimple = true;
+		for (int i = 0; i < 128; i++) {
+			_WLower[i] = _WCType->tolower((wchar_t)i);
+			_WUpper[i] = _WCType->toupper((wchar_t)i);
+			if (_WLower[i] != (i >= 'A' && i <= 'Z' ? i + 32 : i) || _WUpper[i] != (i >= 'a' && i <= 'z' ? i - 32 : i))
+				_WAsciiSimple = false;
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
 	class StringCompareHelper {
 	public:
 		struct IsEqual
@@ -106,40 +534,52 @@ namespace cx {
 
 		struct IsIEqual
 		{
-			IsIEqual() { _Loc = std::locale(); }
+			explicit IsIEqual(const CaseContext& ctx) : _Ctx(&ctx) {}
 
 			template<typename _TChar>
 			bool operator()(const _TChar& c1, const _TChar& c2) const {
-				return std::toupper<_TChar>(c1, _Loc) == std::toupper<_TChar>(c2, _Loc);
+				return _Ctx->to_upper(c1) == _Ctx->to_upper(c2);
 			}
 
 		private:
-			std::locale _Loc;
+			const CaseContext* _Ctx;
 		};
 
 		template<typename TStr>
-		static bool equals(const TStr& src, const TStr& dst, bool ignoreCase /*= false*/)
+		static bool equals(const TStr& src, const TStr& dst, bool ignoreCase, const CaseContext& ctx)
 		{
 			if (src.size() != dst.size()) return false;
 
 			if (ignoreCase)
-				return std::equal(dst.begin(), dst.end(), src.begin(), IsIEqual());
+				return std::equal(dst.begin(), dst.end(), src.begin(), IsIEqual(ctx));
 			else
 				return std::equal(dst.begin(), dst.end(), src.begin());
 		}
 
 		template<typename TStr>
-		static bool starts_with(const TStr& src, const TStr& dst, bool ignoreCase /*= false*/)
+		static bool starts_with(const TStr& src, const TStr& dst, bool ignoreCase, const CaseContext& ctx)
 		{
 			if (src.size() < dst.size()) return false;
 
 			if (ignoreCase)
-				return std::equal(dst.begin(), dst.end(), src.begin(), IsIEqual());
+				return std::equal(dst.begin(), dst.end(), src.begin(), IsIEqual(ctx));
 			else
 				return std::equal(dst.begin(), dst.end(), src.begin());
 		}
 
-		static bool StartsWithC(const char* src, const char* dst, bool ignoreCase /*= false*/)
+		static bool equals(const std::wstring& src, const std::wstring& dst, bool ignoreCase, const CaseContext& ctx)
+		{
+			if (src.size() != dst.size()) return false;
+			return ignoreCase ? WideIEquals(src.data(), dst.data(), src.size(), ctx) : src == dst;
+		}
+
+		static bool starts_with(const std::wstring& src, const std::wstring& dst, bool ignoreCase, const CaseContext& ctx)
+		{
+			if (src.size() < dst.size()) return false;
+			return ignoreCase ? WideIEquals(src.data(), dst.data(), dst.size(), ctx) : src.compare(0, dst.size(), dst) == 0;
+		}
+
+		static bool StartsWithC(const char* src, const char* dst, bool ignoreCase, const CaseContext& ctx)
 		{
 			if (src == NULL || dst == NULL) return false;
 			size_t srcLen = strlen(src);
@@ -147,23 +587,30 @@ namespace cx {
 			if (srcLen < dstLen) return false;
 
 			if (ignoreCase)
-				return std::equal(dst, dst + dstLen, src, StringCompareHelper::IsIEqual());
+				return std::equal(dst, dst + dstLen, src, IsIEqual(ctx));
 			else
 				return std::equal(dst, dst + dstLen, src);
 		}
 
 		template<typename TStr>
-		static bool ends_with(const TStr& src, const TStr& dst, bool ignoreCase /*= false*/)
+		static bool ends_with(const TStr& src, const TStr& dst, bool ignoreCase, const CaseContext& ctx)
 		{
 			if (src.size() < dst.size()) return false;
 
 			if (ignoreCase)
-				return std::equal(dst.rbegin(), dst.rend(), src.rbegin(), StringCompareHelper::IsIEqual());
+				return std::equal(dst.rbegin(), dst.rend(), src.rbegin(), IsIEqual(ctx));
 			else
 				return std::equal(dst.rbegin(), dst.rend(), src.rbegin());
 		}
 
-		static bool EndsWithC(const char* src, const char* dst, bool ignoreCase /*= false*/)
+		static bool ends_with(const std::wstring& src, const std::wstring& dst, bool ignoreCase, const CaseContext& ctx)
+		{
+			if (src.size() < dst.size()) return false;
+			size_t pos = src.size() - dst.size();
+			return ignoreCase ? WideIEquals(src.data() + pos, dst.data(), dst.size(), ctx) : src.compare(pos, dst.size(), dst) == 0;
+		}
+
+		static bool EndsWithC(const char* src, const char* dst, bool ignoreCase, const CaseContext& ctx)
 		{
 			if (src == NULL || dst == NULL) return false;
 			size_t srcLen = strlen(src);
@@ -171,21 +618,43 @@ namespace cx {
 			if (srcLen < dstLen) return false;
 
 			if (ignoreCase)
-				return std::equal(src + srcLen - dstLen, src + srcLen, dst, IsIEqual());
+				return std::equal(src + srcLen - dstLen, src + srcLen, dst, IsIEqual(ctx));
 			else
 				return std::equal(src + srcLen - dstLen, src + srcLen, dst);
 		}
 
 		template<typename TStr>
-		static bool contains(const TStr& src, const TStr& dst, bool ignoreCase /*= false*/)
+		static bool contains(const TStr& src, const TStr& dst, bool ignoreCase, const CaseContext& ctx)
 		{
 			if (ignoreCase)
-				return std::search(src.begin(), src.end(), dst.begin(), dst.end(), IsIEqual()) != src.end();
+				return std::search(src.begin(), src.end(), dst.begin(), dst.end(), IsIEqual(ctx)) != src.end();
 			else
 				return std::search(src.begin(), src.end(), dst.begin(), dst.end()) != src.end();
 		}
 
-		static bool ContainsC(const char* src, const char* dst, bool ignoreCase /*= false*/)
+		template<typename TStr>
+		static size_t find(const TStr& src, const TStr& dst, size_t pos, bool ignoreCase, const CaseContext& ctx)
+		{
+			if (!ignoreCase)
+				return src.find(dst, pos);
+
+			if (pos > src.size()) return TStr::npos;
+			typename TStr::const_iterator it = std::search(src.begin() + pos, src.end(), dst.begin(), dst.end(), IsIEqual(ctx));
+			return it == src.end() && !dst.empty() ? TStr::npos : (size_t)(it - src.begin());
+		}
+
+		static bool contains(const std::wstring& src, const std::wstring& dst, bool ignoreCase, const CaseContext& ctx)
+		{
+			return find(src, dst, 0, ignoreCase, ctx) != std::wstring::npos;
+		}
+
+		static size_t find(const std::wstring& src, const std::wstring& dst, size_t pos, bool ignoreCase, const CaseContext& ctx)
+		{
+			size_t i = WideFind(src.data(), src.size(), dst.data(), dst.size(), pos, ignoreCase, ctx);
+			return i == (size_t)-1 ? std::wstring::npos : i;
+		}
+
+		static bool ContainsC(const char* src, const char* dst, bool ignoreCase, const CaseContext& ctx)
 		{
 			if (src == NULL || dst == NULL) return false;
 			size_t srcLen = strlen(src);
@@ -193,187 +662,1112 @@ namespace cx {
 			if (srcLen < dstLen) return false;
 
 			if (ignoreCase)
-				return std::search(src, src + srcLen, dst, dst + dstLen, IsIEqual()) != (src + srcLen);
+				return std::search(src, src + srcLen, dst, dst + dstLen, IsIEqual(ctx)) != (src + srcLen);
 			else
 				return std::search(src, src + srcLen, dst, dst + dstLen) != (src + srcLen);
 		}
 	};
 
+	// Three-way and natural-order comparison, and the matching memcmp-ordered sort keys.
+	class SortKeyHelper {
+	public:
+		static unsigned int unit(char c, bool ignoreCase, const CaseContext& ctx) {
+			return (unsigned char)(ignoreCase ? ctx.to_lower(c) : c);
+		}
+
+		static unsigned int unit(wchar_t c, bool ignoreCase, const CaseContext& ctx) {
+			return (unsigned int)(ignoreCase ? ctx.to_lower(c) : c);
+		}
+
+		template<typename TChar>
+		static bool is_digit(TChar c) { return c >= '0' && c <= '9'; }
+
+		template<typename TStr>
+		static int compare(const TStr& a, const TStr& b, bool ignoreCase, const CaseContext& ctx) {
+			size_t n = std::min(a.size(), b.size());
+			for (size_t i = 0; i < n; i++) {
+				unsigned int ua = unit(a[i], ignoreCase, ctx), ub = unit(b[i], ignoreCase, ctx);
+				if (ua != ub) return ua < ub ? -1 : 1;
+			}
+			return a.size() < b.size() ? -1 : a.size() > b.size() ? 1 : 0;
+		}
+
+		// A digit run compares with other digit runs by value, and with other characters as '0'.
+		template<typename TStr>
+		static int compare_natural(const TStr& a, const TStr& b, bool ignoreCase, const CaseContext& ctx) {
+			size_t i = 0, j = 0;
+			while (i < a.size() && j < b.size()) {
+				if (is_digit(a[i]) && is_digit(b[j])) {
+					size_t si = skip_zeros(a, i), sj = skip_zeros(b, j);
+					i = skip_digits(a, si);
+					j = skip_digits(b, sj);
+					if (i - si != j - sj) return i - si < j - sj ? -1 : 1;
+					for (size_t k = 0; k < i - si; k++) {
+						if (a[si + k] != b[sj + k]) return a[si + k] < b[sj + k] ? -1 : 1;
+					}
+					continue;
+				}
+
+				unsigned int ua = is_digit(a[i]) ? '0' : unit(a[i], ignoreCase, ctx);
+				unsigned int ub = is_digit(b[j]) ? '0' : unit(b[j], ignoreCase, ctx);
+				if (ua != ub) return ua < ub ? -1 : 1;
+				i++;
+				j++;
+			}
+			return i < a.size() ? 1 : j < b.size() ? -1 : 0;
+		}
+
+		template<typename TStr>
+		static std::string make_key(const TStr& s, bool ignoreCase, bool natural, const CaseContext& ctx) {
+			std::string key;
+			key.reserve(s.size() * sizeof(s[0]) + 2);
+			for (size_t i = 0; i < s.size();) {
+				if (!natural || !is_digit(s[i])) {
+					append_unit(key, unit(s[i++], ignoreCase, ctx), sizeof(s[0]) == 1);
+					continue;
+				}
+
+				// '0', the digit count without leading zeros, then those digits.
+				size_t first = skip_zeros(s, i);
+				i = skip_digits(s, first);
+				size_t len = i - first;
+				key += '0';
+				if (len < 255) {
+					key += (char)len;
+				}
+				else {
+					key += (char)255;
+					for (int shift = 24; shift >= 0; shift -= 8)
+						key += (char)((len >> shift) & 0xFF);
+				}
+				for (; first < i; first++)
+					key += (char)s[first];
+			}
+			return key;
+		}
+
+	private:
+		template<typename TStr>
+		static size_t skip_zeros(const TStr& s, size_t i) {
+			while (i < s.size() && s[i] == '0') i++;
+			return i;
+		}
+
+		template<typename TStr>
+		static size_t skip_digits(const TStr& s, size_t i) {
+			while (i < s.size() && is_digit(s[i])) i++;
+			return i;
+		}
+
+		// Bytes are stored as they are. Wide units use a UTF-8 style encoding extended to
+		// 32 bits, which keeps the order of unit values.
+		static void append_unit(std::string& key, unsigned int u, bool narrow) {
+			if (narrow || u < 0x80) {
+				key += (char)u;
+				return;
+			}
+
+			int tail = u < 0x800 ? 1 : u < 0x10000 ? 2 : u < 0x200000 ? 3 : u < 0x4000000 ? 4 : 5;
+			static const unsigned char lead[] = { 0, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC };
+			key += (char)(lead[tail] | (u >> (6 * tail)));
+			for (int k = tail - 1; k >= 0; k--)
+				key += (char)(0x80 | ((u >> (6 * k)) & 0x3F));
+		}
+	};
+
 	class StringCaseHelper {
 	public:
 		struct ToLowerCvter
 		{
-			ToLowerCvter() { _Loc = std::locale(); }
+			explicit ToLowerCvter(const CaseContext& ctx) : _Ctx(&ctx) {}
 
 			template<typename _TChar>
 			_TChar operator()(const _TChar& c) const {
-				return std::tolower(c, _Loc);
+				return _Ctx->to_lower(c);
 			}
 
 		private:
-			std::locale _Loc;
+			const CaseContext* _Ctx;
 		};
 
 		struct ToUpperCvter
 		{
-			ToUpperCvter() { _Loc = std::locale(); }
+			explicit ToUpperCvter(const CaseContext& ctx) : _Ctx(&ctx) {}
 
 			template<typename _TChar>
 			_TChar operator()(const _TChar& c) const {
-				return std::toupper(c, _Loc);
+				return _Ctx->to_upper(c);
 			}
 
 		private:
-			std::locale _Loc;
+			const CaseContext* _Ctx;
 		};
 
 		template<typename TStr>
-		static void to_lower(TStr& s) {
-			std::transform(s.begin(), s.end(), s.begin(), ToLowerCvter());
+		static void to_lower(TStr& s, const CaseContext& ctx) {
+			std::transform(s.begin(), s.end(), s.begin(), ToLowerCvter(ctx));
+		}
+
+		static void to_lower(std::wstring& s, const CaseContext& ctx) {
+			if (!s.empty()) WideFoldCase(&s[0], s.size(), false, ctx);
 		}
 
 		template<typename TStr>
-		static void to_lower_copy(const TStr& src, TStr& dst) {
+		static void to_lower_copy(const TStr& src, TStr& dst, const CaseContext& ctx) {
 			dst.resize(src.size());
-			std::transform(src.begin(), src.end(), dst.begin(), ToLowerCvter());
+			std::transform(src.begin(), src.end(), dst.begin(), ToLowerCvter(ctx));
+		}
+
+		static void to_lower_copy(const std::wstring& src, std::wstring& dst, const CaseContext& ctx) {
+			dst = src;
+			to_lower(dst, ctx);
 		}
 
 		template<typename TStr>
-		static TStr to_lower_copy(const TStr& src) {
+		static TStr to_lower_copy(const TStr& src, const CaseContext& ctx) {
 			TStr dst;
-			to_lower_copy(src, dst);
+			to_lower_copy(src, dst, ctx);
 			return dst;
 		}
 
 		template<typename TStr>
-		static void to_upper(TStr& s) {
-			std::transform(s.begin(), s.end(), s.begin(), ToUpperCvter());
+		static void to_upper(TStr& s, const CaseContext& ctx) {
+			std::transform(s.begin(), s.end(), s.begin(), ToUpperCvter(ctx));
+		}
+
+		static void to_upper(std::wstring& s, const CaseContext& ctx) {
+			if (!s.empty()) WideFoldCase(&s[0], s.size(), true, ctx);
 		}
 
 		template<typename TStr>
-		static void to_upper_copy(const TStr& src, TStr& dst) {
+		static void to_upper_copy(const TStr& src, TStr& dst, const CaseContext& ctx) {
 			dst.resize(src.size());
-			std::transform(src.begin(), src.end(), dst.begin(), ToUpperCvter());
+			std::transform(src.begin(), src.end(), dst.begin(), ToUpperCvter(ctx));
+		}
+
+		static void to_upper_copy(const std::wstring& src, std::wstring& dst, const CaseContext& ctx) {
+			dst = src;
+			to_upper(dst, ctx);
 		}
 
 		template<typename TStr>
-		static TStr to_upper_copy(const TStr& src) {
+		static TStr to_upper_copy(const TStr& src, const CaseContext& ctx) {
 			TStr dst;
-			to_upper_copy(src, dst);
+			to_upper_copy(src, dst, ctx);
 			return dst;
 		}
 	};
 
 	//////////////////////////////////////////////////////////////////////////
-	bool cstarts_with(const char* src, const char* dst, bool ignoreCase)
-	{
-		return StringCompareHelper::StartsWithC(src, dst, ignoreCase);
-	}
-
-	bool cends_with(const char* src, const char* dst, bool ignoreCase /*= false*/)
-	{
-		return StringCompareHelper::EndsWithC(src, dst, ignoreCase);
-	}
-
-	bool ccontains(const char* src, const char* dst, bool ignoreCase)
-	{
-		return StringCompareHelper::ContainsC(src, dst, ignoreCase);
-	}
 	//////////////////////////////////////////////////////////////////////////
-	void trim(std::string& src) {
-		StringTrimHelper::trim(src, CxTrimChars);
+	// Bit i of the result is set if the byte p[i] equals c, for 64 bytes.
+	static inline unsigned long long ByteMask64(const char* p, char c) {
+#ifdef CX_SSE2
+		__m128i v = _mm_set1_epi8(c);
+		unsigned long long m0 = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), v));
+		unsigned long long m1 = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 16)), v));
+		unsigned long long m2 = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 32)), v));
+		unsigned long long m3 = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 48)), v));
+		return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+#else
+		unsigned long long m = 0;
+		for (int i = 0; i < 64; i++)
+			m |= (unsigned long long)(p[i] == c) << i;
+		return m;
+#endif
 	}
 
-	void trim(std::wstring& src) {
-		StringTrimHelper::trim(src, CxWTrimChars);
+	// Bit i of the result is the parity of the set bits [0, i] of x.
+	static inline unsigned long long PrefixXor64(unsigned long long x) {
+		x ^= x << 1;
+		x ^= x << 2;
+		x ^= x << 4;
+		x ^= x << 8;
+		x ^= x << 16;
+		x ^= x << 32;
+		return x;
 	}
 
-	void trim(const std::string& src, std::string& dst) {
-		StringTrimHelper::trim_copy(src, dst, CxTrimChars);
-	}
+	// 64-bit hash of a byte string, mixing 8 bytes per step.
+	static inline unsigned long long HashBytes(const char* p, size_t n) {
+		const unsigned long long k = 0x9E3779B97F4A7C15ULL;
+		unsigned long long h = n * k, w;
+		size_t i = 0;
+		for (; n - i >= 8; i += 8) {
+			memcpy(&w, p + i, 8);
+			h = (h ^ w) * k;
+			h ^= h >> 29;
+		}
+		w = 0;
+		if (n > i) memcpy(&w, p + i, n - i);	// p may be NULL when n is 0
+		h = (h ^ w) * k;
 
-	void trim(const std::wstring& src, std::wstring& dst) {
-		StringTrimHelper::trim_copy(src, dst, CxWTrimChars);
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ULL;
+		h ^= h >> 33;
+		return h;
 	}
 
-	void trim(const std::string& src, std::string& dst, const std::string& trimChars) {
-		StringTrimHelper::trim_copy(src, dst, trimChars);
-	}
+	class Utf8Helper {
+	public:
+		// Decode one code point; returns the sequence length, or 0 for an invalid sequence.
+		static size_t decode(const unsigned char* p, size_t n, unsigned int& cp) {
+			unsigned char c = p[0];
+			if (c < 0x80) { cp = c; return 1; }
 
-	void trim(const std::wstring& src, std::wstring& dst, const std::wstring& trimChars) {
-		StringTrimHelper::trim_copy(src, dst, trimChars);
-	}
+			size_t len;
+			unsigned int minCp;
+			if ((c & 0xE0) == 0xC0) { len = 2; cp = c & 0x1F; minCp = 0x80; }
+			else if ((c & 0xF0) == 0xE0) { len = 3; cp = c & 0x0F; minCp = 0x800; }
+			else if ((c & 0xF8) == 0xF0) { len = 4; cp = c & 0x07; minCp = 0x10000; }
+			else return 0;
 
-	std::string  trim_copy(const std::string& src) {
-		return StringTrimHelper::trim_copy(src, CxTrimChars);
-	}
+			if (n < len) return 0;
+			for (size_t i = 1; i < len; i++) {
+				if ((p[i] & 0xC0) != 0x80) return 0;
+				cp = (cp << 6) | (p[i] & 0x3F);
+			}
 
-	std::wstring trim_copy(const std::wstring& src) {
-		return StringTrimHelper::trim_copy(src, CxWTrimChars);
-	}
+			if (cp < minCp || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+			return len;
+		}
 
-	std::string trim_copy(const std::string& src, const std::string& trimChars) {
-		return StringTrimHelper::trim_copy(src, trimChars);
-	}
+		static size_t encoded_length(unsigned int cp) {
+			return cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+		}
 
-	std::wstring trim_copy(const std::wstring& src, const std::wstring& trimChars) {
-		return StringTrimHelper::trim_copy(src, trimChars);
-	}
+		static size_t encode(unsigned int cp, unsigned char* p) {
+			if (cp < 0x80) { p[0] = (unsigned char)cp; return 1; }
+			if (cp < 0x800) {
+				p[0] = (unsigned char)(0xC0 | (cp >> 6));
+				p[1] = (unsigned char)(0x80 | (cp & 0x3F));
+				return 2;
+			}
+			if (cp < 0x10000) {
+				p[0] = (unsigned char)(0xE0 | (cp >> 12));
+				p[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+				p[2] = (unsigned char)(0x80 | (cp & 0x3F));
+				return 3;
+			}
+			p[0] = (unsigned char)(0xF0 | (cp >> 18));
+			p[1] = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+			p[2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+			p[3] = (unsigned char)(0x80 | (cp & 0x3F));
+			return 4;
+		}
+	};
 
-	void trim_start(std::string& src) {
-		StringTrimHelper::trim_start(src, CxTrimChars);
-	}
+	// Unicode simple case mapping ranges, keyed by the uppercase code point.
+	// None of the mappings lengthen the UTF-8 encoding, so conversions can run in place.
+	struct Utf8CaseRange {
+		unsigned int lo;		// first uppercase code point
+		unsigned int hi;		// last uppercase code point
+		int delta;				// lowercase = uppercase + delta
+		unsigned char stride;	// 1: every code point in range, 2: every other one
+		unsigned char flags;
+	};
 
-	void trim_start(std::wstring& src) {
-		StringTrimHelper::trim_start(src, CxWTrimChars);
-	}
+	enum { CxMapLower = 1, CxMapUpper = 2, CxMapFold = 4 };
 
-	void trim_start(const std::string& src, std::string& dst) {
-		StringTrimHelper::trim_start_copy(src, dst, CxTrimChars);
-	}
+	static const Utf8CaseRange CxUtf8CaseRanges[] = {
+		{ 0x0049, 0x0049, 232, 1, CxMapUpper },					// dotless i
+		{ 0x0053, 0x0053, 300, 1, CxMapUpper | CxMapFold },		// long s
+		{ 0x00C0, 0x00D6, 32, 1, CxMapLower | CxMapUpper },
+		{ 0x00D8, 0x00DE, 32, 1, CxMapLower | CxMapUpper },
+		{ 0x0100, 0x012E, 1, 2, CxMapLower | CxMapUpper },
+		{ 0x0130, 0x0130, -199, 1, CxMapLower },				// capital I with dot
+		{ 0x0132, 0x0136, 1, 2, CxMapLower | CxMapUpper },
+		{ 0x0139, 0x0147, 1, 2, CxMapLower | CxMapUpper },
+		{ 0x014A, 0x0176, 1, 2, CxMapLower | CxMapUpper },
+		{ 0x0178, 0x0178, -121, 1, CxMapLower | CxMapUpper },
+		{ 0x0179, 0x017D, 1, 2, CxMapLower | CxMapUpper },
+		{ 0x0386, 0x0386, 38, 1, CxMapLower | CxMapUpper },
+		{ 0x0388, 0x038A, 37, 1, CxMapLower | CxMapUpper },
+		{ 0x038C, 0x038C, 64, 1, CxMapLower | CxMapUpper },
+		{ 0x038E, 0x038F, 63, 1, CxMapLower | CxMapUpper },
+		{ 0x0391, 0x03A1, 32, 1, CxMapLower | CxMapUpper },
+		{ 0x039C, 0x039C, -743, 1, CxMapUpper | CxMapFold },	// micro sign
+		{ 0x03A3, 0x03A3, 31, 1, CxMapUpper | CxMapFold },		// final sigma
+		{ 0x03A3, 0x03AB, 32, 1, CxMapLower | CxMapUpper },
+		{ 0x03D8, 0x03EE, 1, 2, CxMapLower | CxMapUpper },
+		{ 0x0400, 0x040F, 80, 1, CxMapLower | CxMapUpper },
+		{ 0x0410, 0x042F, 32, 1, CxMapLower | CxMapUpper },
+		{ 0x0460, 0x0480, 1, 2, CxMapLower | CxMapUpper },
+		{ 0x048A, 0x04BE, 1, 2, CxMapLower | CxMapUpper },
+		{ 0x04C0, 0x04C0, 15, 1, CxMapLower | CxMapUpper },
+		{ 0x04C1, 0x04CD, 1, 2, CxMapLower | CxMapUpper },
+		{ 0x04D0, 0x052E, 1, 2, CxMapLower | CxMapUpper },
+		{ 0x0531, 0x0556, 48, 1, CxMapLower | CxMapUpper },
+		{ 0x1E00, 0x1E94, 1, 2, CxMapLower | CxMapUpper },
+		{ 0x1E9E, 0x1E9E, -7615, 1, CxMapLower },				// capital sharp s
+		{ 0x1EA0, 0x1EFE, 1, 2, CxMapLower | CxMapUpper },
+		{ 0xFF21, 0xFF3A, 32, 1, CxMapLower | CxMapUpper },
+	};
 
-	void trim_start(const std::wstring& src, std::wstring& dst) {
-		StringTrimHelper::trim_start_copy(src, dst, CxWTrimChars);
-	}
+	class Utf8CaseHelper {
+	public:
+		static unsigned int map_lower(unsigned int cp) {
+			if (cp < 0x80)
+				return (cp >= 'A' && cp <= 'Z') ? cp + 32 : cp;
 
-	void trim_start(const std::string& src, std::string& dst, const std::string& trimChars) {
-		StringTrimHelper::trim_start_copy(src, dst, trimChars);
-	}
+			for (size_t i = 0; i < sizeof(CxUtf8CaseRanges) / sizeof(CxUtf8CaseRanges[0]); i++) {
+				const Utf8CaseRange& r = CxUtf8CaseRanges[i];
+				if ((r.flags & CxMapLower) && cp >= r.lo && cp <= r.hi && (cp - r.lo) % r.stride == 0)
+					return cp + r.delta;
+			}
+			return cp;
+		}
 
-	void trim_start(const std::wstring& src, std::wstring& dst, const std::wstring& trimChars) {
-		StringTrimHelper::trim_start_copy(src, dst, trimChars);
-	}
+		static unsigned int map_upper(unsigned int cp, int flags = CxMapUpper) {
+			if (cp < 0x80 && (flags & CxMapUpper))
+				return (cp >= 'a' && cp <= 'z') ? cp - 32 : cp;
 
-	std::string  trim_start_copy(const std::string& src) {
-		return StringTrimHelper::trim_start_copy(src, CxTrimChars);
-	}
+			for (size_t i = 0; i < sizeof(CxUtf8CaseRanges) / sizeof(CxUtf8CaseRanges[0]); i++) {
+				const Utf8CaseRange& r = CxUtf8CaseRanges[i];
+				unsigned int u = cp - r.delta;
+				if ((r.flags & flags) && u >= r.lo && u <= r.hi && (u - r.lo) % r.stride == 0)
+					return u;
+			}
+			return cp;
+		}
 
-	std::wstring trim_start_copy(const std::wstring& src) {
-		return StringTrimHelper::trim_start_copy(src, CxWTrimChars);
-	}
+		static unsigned int map_fold(unsigned int cp) {
+			unsigned int l = map_lower(cp);
+			if (l != cp) return l;
 
-	std::string trim_start_copy(const std::string& src, const std::string& trimChars) {
-		return StringTrimHelper::trim_start_copy(src, trimChars);
-	}
+			unsigned int u = map_upper(cp, CxMapFold);
+			return u != cp ? map_lower(u) : cp;
+		}
 
-	std::wstring trim_start_copy(const std::wstring& src, const std::wstring& trimChars) {
-		return StringTrimHelper::trim_start_copy(src, trimChars);
-	}
+#ifdef CX_SSE2
+		// Flip the case bit of the ASCII letters in [first, first + 25].
+		static __m128i ascii_flip(__m128i v, char first) {
+			__m128i t = _mm_add_epi8(v, _mm_set1_epi8((char)(128 - first)));
+			__m128i m = _mm_cmplt_epi8(t, _mm_set1_epi8((char)(-128 + 26)));
+			return _mm_xor_si128(v, _mm_and_si128(m, _mm_set1_epi8(0x20)));
+		}
+#endif
 
-	void trim_end(std::string& src) {
-		StringTrimHelper::trim_end(src, CxTrimChars);
-	}
+		enum Mode { Lower, Upper, Fold };
+
+		// Convert n bytes from src to dst, which may alias src. Returns the output length.
+		static size_t convert(const unsigned char* src, size_t n, unsigned char* dst, Mode mode) {
+			size_t i = 0, o = 0;
+			char first = mode == Upper ? 'a' : 'A';
+
+			while (i < n) {
+#ifdef CX_SSE2
+				if (n - i >= 16) {
+					__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+					if (_mm_movemask_epi8(v) == 0) {
+						_mm_storeu_si128((__m128i*)(dst + o), ascii_flip(v, first));
+						i += 16; o += 16;
+						continue;
+					}
+				}
+#endif
+				unsigned char c = src[i];
+				if (c < 0x80) {
+					dst[o++] = (c >= first && c <= first + 25) ? (unsigned char)(c ^ 0x20) : c;
+					i++;
+					continue;
+				}
+
+				unsigned int cp;
+				size_t len = Utf8Helper::decode(src + i, n - i, cp);
+				if (len == 0) {
+					dst[o++] = c;
+					i++;
+					continue;
+				}
+
+				unsigned int mapped = mode == Lower ? map_lower(cp) : mode == Upper ? map_upper(cp) : map_fold(cp);
+				if (Utf8Helper::encoded_length(mapped) > len) mapped = cp;
+				i += len;
+				o += Utf8Helper::encode(mapped, dst + o);
+			}
+			return o;
+		}
+
+		static void convert(std::string& s, Mode mode) {
+			if (s.empty()) return;
+			unsigned char* p = (unsigned char*)&s[0];
+			s.resize(convert(p, s.size(), p, mode));
+		}
+
+		static void convert(const std::string& src, std::string& dst, Mode mode) {
+			dst.resize(src.size());
+			if (src.empty()) return;
+			dst.resize(convert((const unsigned char*)src.data(), src.size(), (unsigned char*)&dst[0], mode));
+		}
+
+		// Compare case folded code points until dst is consumed. Returns true if all of dst matched.
+		static bool fold_match(const std::string& src, const std::string& dst, bool whole) {
+			const unsigned char* a = (const unsigned char*)src.data();
+			const unsigned char* b = (const unsigned char*)dst.data();
+			size_t na = src.size(), nb = dst.size(), i = 0, j = 0;
+
+			while (j < nb) {
+				if (i >= na) return false;
+#ifdef CX_SSE2
+				if (na - i >= 16 && nb - j >= 16) {
+					__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+					__m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+					if (_mm_movemask_epi8(_mm_or_si128(va, vb)) == 0) {
+						__m128i eq = _mm_cmpeq_epi8(ascii_flip(va, 'A'), ascii_flip(vb, 'A'));
+						if (_mm_movemask_epi8(eq) != 0xFFFF) return false;
+						i += 16; j += 16;
+						continue;
+					}
+				}
+#endif
+				unsigned int ca, cb;
+				size_t la = Utf8Helper::decode(a + i, na - i, ca);
+				size_t lb = Utf8Helper::decode(b + j, nb - j, cb);
+				// Invalid bytes only match the identical invalid byte.
+				if (la == 0) { ca = 0x110000 + a[i]; la = 1; }
+				if (lb == 0) { cb = 0x110000 + b[j]; lb = 1; }
+				if (ca != cb && map_fold(ca) != map_fold(cb)) return false;
+				i += la; j += lb;
+			}
+			return !whole || i == na;
+		}
+	};
+
+	template<typename TUnit>
+	class Utf8Transcoder {
+	public:
+		static unsigned int unit(TUnit c) {
+			return sizeof(TUnit) == 2 ? (unsigned int)(unsigned short)c : (unsigned int)c;
+		}
+
+		static bool from_utf8(const char* src, size_t srcLen, TUnit* dst, size_t& dstLen) {
+			const unsigned char* p = (const unsigned char*)src;
+			size_t cap = dstLen, i = 0, o = 0;
+			dstLen = 0;
+
+			while (i < srcLen) {
+#ifdef CX_SSE2
+				if (srcLen - i >= 16 && cap - o >= 16) {
+					__m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+					if (_mm_movemask_epi8(v) == 0) {
+						store_ascii(v, dst + o);
+						i += 16; o += 16;
+						continue;
+					}
+				}
+#endif
+				unsigned int cp;
+				size_t len = Utf8Helper::decode(p + i, srcLen - i, cp);
+				if (len == 0) return false;
+
+				if (sizeof(TUnit) == 2 && cp >= 0x10000) {
+					if (cap - o < 2) return false;
+					cp -= 0x10000;
+					dst[o++] = (TUnit)(0xD800 + (cp >> 10));
+					dst[o++] = (TUnit)(0xDC00 + (cp & 0x3FF));
+				}
+				else {
+					if (cap - o < 1) return false;
+					dst[o++] = (TUnit)cp;
+				}
+				i += len;
+			}
+
+			dstLen = o;
+			return true;
+		}
+
+		static bool to_utf8(const TUnit* src, size_t srcLen, char* dst, size_t& dstLen) {
+			unsigned char* p = (unsigned char*)dst;
+			size_t cap = dstLen, i = 0, o = 0;
+			dstLen = 0;
+
+			while (i < srcLen) {
+#ifdef CX_SSE2
+				if (srcLen - i >= 8 && cap - o >= 8 && load_ascii(src + i, p + o)) {
+					i += 8; o += 8;
+					continue;
+				}
+#endif
+				unsigned int cp = unit(src[i++]);
+				if (sizeof(TUnit) == 2 && cp >= 0xD800 && cp <= 0xDBFF) {
+					if (i == srcLen) return false;
+					unsigned int lo = unit(src[i]);
+					if (lo < 0xDC00 || lo > 0xDFFF) return false;
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+					i++;
+				}
+				else if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+					return false;
+				}
+
+				if (cap - o < Utf8Helper::encoded_length(cp)) return false;
+				o += Utf8Helper::encode(cp, p + o);
+			}
+
+			dstLen = o;
+			return true;
+		}
+
+#ifdef CX_SSE2
+	private:
+		// Widen 16 ASCII bytes to 16 code units.
+		static void store_ascii(__m128i v, TUnit* dst) {
+			__m128i zero = _mm_setzero_si128();
+			__m128i lo = _mm_unpacklo_epi8(v, zero);
+			__m128i hi = _mm_unpackhi_epi8(v, zero);
+			if (sizeof(TUnit) == 2) {
+				_mm_storeu_si128((__m128i*)dst, lo);
+				_mm_storeu_si128((__m128i*)(dst + 8), hi);
+			}
+			else {
+				_mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(lo, zero));
+				_mm_storeu_si128((__m128i*)(dst + 4), _mm_unpackhi_epi16(lo, zero));
+				_mm_storeu_si128((__m128i*)(dst + 8), _mm_unpacklo_epi16(hi, zero));
+				_mm_storeu_si128((__m128i*)(dst + 12), _mm_unpackhi_epi16(hi, zero));
+			}
+		}
+
+		// Narrow 8 code units to bytes if they are all ASCII.
+		static bool load_ascii(const TUnit* src, unsigned char* dst) {
+			__m128i v;
+			if (sizeof(TUnit) == 2) {
+				v = _mm_loadu_si128((const __m128i*)src);
+				if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short)0xFF80)), _mm_setzero_si128())) != 0xFFFF)
+					return false;
+			}
+			else {
+				__m128i a = _mm_loadu_si128((const __m128i*)src);
+				__m128i b = _mm_loadu_si128((const __m128i*)(src + 4));
+				__m128i high = _mm_and_si128(_mm_or_si128(a, b), _mm_set1_epi32(~0x7F));
+				if (_mm_movemask_epi8(_mm_cmpeq_epi32(high, _mm_setzero_si128())) != 0xFFFF)
+					return false;
+				v = _mm_packs_epi32(a, b);
+			}
+			_mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(v, v));
+			return true;
+		}
+#endif
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	class ParallelHelper {
+	public:
+		// Number of workers to use for n items: threads == 0 means one per hardware thread,
+		// and no worker gets fewer than minPerThread items.
+		static size_t worker_count(size_t n, size_t threads, size_t minPerThread) {
+			if (threads == 0) {
+				threads = std::thread::hardware_concurrency();
+				if (threads == 0) threads = 1;
+			}
+			size_t most = n / (minPerThread > 0 ? minPerThread : 1);
+			if (threads > most) threads = most;
+			return threads > 0 ? threads : 1;
+		}
+
+		// Call fn(begin, end) on contiguous, disjoint ranges covering [0, n), one per worker.
+		// The calling thread processes the first range itself.
+		template<typename Fn>
+		static void for_ranges(size_t n, size_t workers, Fn fn) {
+			if (workers <= 1) {
+				fn((size_t)0, n);
+				return;
+			}
+
+			std::vector<std::thread> pool;
+			pool.reserve(workers - 1);
+			size_t step = (n + workers - 1) / workers;
+			for (size_t begin = step; begin < n; begin += step)
+				pool.push_back(std::thread(fn, begin, std::min(n, begin + step)));
+
+			fn((size_t)0, std::min(n, step));
+			for (size_t i = 0; i < pool.size(); i++)
+				pool[i].join();
+		}
+	};
+
+	class StringBatchHelper {
+	public:
+		// Vectors smaller than this per worker are not worth a thread.
+		enum { MinPerThread = 4096, BlockSize = 64 };
+
+		struct Trimmer {
+			template<typename TStr>
+			void operator()(TStr& s) const { cx::trim(s); }
+		};
+
+		struct Lowerer {
+			explicit Lowerer(const CaseContext& ctx) : _Ctx(&ctx) {}
+			template<typename TStr>
+			void operator()(TStr& s) const { StringCaseHelper::to_lower(s, *_Ctx); }
+		private:
+			const CaseContext* _Ctx;
+		};
+
+		struct Upperer {
+			explicit Upperer(const CaseContext& ctx) : _Ctx(&ctx) {}
+			template<typename TStr>
+			void operator()(TStr& s) const { StringCaseHelper::to_upper(s, *_Ctx); }
+		private:
+			const CaseContext* _Ctx;
+		};
+
+		template<typename TStr, typename Op>
+		static void for_each(std::vector<TStr>& strArray, size_t threads, Op op) {
+			size_t workers = ParallelHelper::worker_count(strArray.size(), threads, MinPerThread);
+			ParallelHelper::for_ranges(strArray.size(), workers, [&strArray, op](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++)
+					op(strArray[i]);
+			});
+		}
+
+		template<typename TStr>
+		static bool contains_any_of(const std::vector<TStr>& strArray, const TStr& needle, bool ignoreCase, size_t threads, const CaseContext& ctx) {
+			std::atomic<bool> found(false);
+			size_t workers = ParallelHelper::worker_count(strArray.size(), threads, MinPerThread);
+			ParallelHelper::for_ranges(strArray.size(), workers, [&](size_t begin, size_t end) {
+				// Check for an early hit from another worker once per block.
+				for (size_t block = begin; block < end && !found.load(std::memory_order_relaxed); block += BlockSize) {
+					size_t blockEnd = std::min(end, block + (size_t)BlockSize);
+					for (size_t i = block; i < blockEnd; i++) {
+						if (StringCompareHelper::contains(strArray[i], needle, ignoreCase, ctx)) {
+							found.store(true, std::memory_order_relaxed);
+							return;
+						}
+					}
+				}
+			});
+			return found.load();
+		}
+	};
+
+	// Multikey quicksort over 8-byte chunks of the (folded) strings. The chunk at the current depth
+	// is cached next to the string index, so partitioning never touches the strings themselves.
+	template<typename TChar>
+	class StringSortHelper {
+	public:
+		typedef std::basic_string<TChar> TStr;
+
+		// Arrays smaller than this per worker are sorted on one thread.
+		enum { MinPerThread = 1 << 15, SmallBucket = 16, Units = 8 / sizeof(TChar), UnitBits = 64 / Units };
+
+		StringSortHelper(std::vector<TStr>& strArray, bool ignoreCase, const CaseContext& ctx)
+			: _Strs(strArray), _IgnoreCase(ignoreCase), _Ctx(&ctx) {}
+
+		void run(size_t threads) {
+			size_t n = _Strs.size();
+			if (n < 2) return;
+
+			_Entries.resize(n);
+			for (size_t i = 0; i < n; i++) {
+				_Entries[i].index = i;
+				_Entries[i].key = chunk(_Strs[i], 0);
+			}
+
+			size_t workers = ParallelHelper::worker_count(n, threads, MinPerThread);
+			if (workers <= 1)
+				sort(0, n, 0, depth_limit(n));
+			else
+				sort_parallel(workers);
+
+			std::vector<TStr> sorted(n);
+			for (size_t i = 0; i < n; i++)
+				sorted[i].swap(_Strs[_Entries[i].index]);
+			_Strs.swap(sorted);
+		}
+
+	private:
+		struct Entry {
+			unsigned long long key;
+			size_t index;
+		};
+
+		unsigned long long chunk(const TStr& s, size_t depth) const {
+			unsigned long long key = 0;
+			for (size_t u = 0; u < Units; u++) {
+				key <<= UnitBits;
+				if (depth + u < s.size()) key |= SortKeyHelper::unit(s[depth + u], _IgnoreCase, *_Ctx);
+			}
+			return key;
+		}
+
+		bool less(const Entry& a, const Entry& b, size_t depth) const {
+			if (a.key != b.key) return a.key < b.key;
+
+			const TStr& x = _Strs[a.index];
+			const TStr& y = _Strs[b.index];
+			size_t n = std::min(x.size(), y.size());
+			for (size_t i = depth + Units; i < n; i++) {
+				unsigned int ux = SortKeyHelper::unit(x[i], _IgnoreCase, *_Ctx);
+				unsigned int uy = SortKeyHelper::unit(y[i], _IgnoreCase, *_Ctx);
+				if (ux != uy) return ux < uy;
+			}
+			return x.size() < y.size();
+		}
+
+		void insertion_sort(size_t lo, size_t hi, size_t depth) {
+			for (size_t i = lo + 1; i < hi; i++) {
+				Entry e = _Entries[i];
+				size_t j = i;
+				for (; j > lo && less(e, _Entries[j - 1], depth); j--)
+					_Entries[j] = _Entries[j - 1];
+				_Entries[j] = e;
+			}
+		}
+
+		// Partitioning rounds allowed on one chunk before falling back to heapsort, as in introsort.
+		static size_t depth_limit(size_t n) {
+			size_t rounds = 0;
+			for (; n > 1; n >>= 1) rounds += 2;
+			return rounds;
+		}
+
+		void heap_sort(size_t lo, size_t hi, size_t depth) {
+			typename std::vector<Entry>::iterator first = _Entries.begin() + lo, last = _Entries.begin() + hi;
+			std::make_heap(first, last, [this, depth](const Entry& a, const Entry& b) { return less(a, b, depth); });
+			std::sort_heap(first, last, [this, depth](const Entry& a, const Entry& b) { return less(a, b, depth); });
+		}
+
+		void sort(size_t lo, size_t hi, size_t depth, size_t rounds) {
+			while (hi - lo > SmallBucket) {
+				if (rounds == 0) {
+					heap_sort(lo, hi, depth);
+					return;
+				}
+				rounds--;
+
+				unsigned long long a = _Entries[lo].key, b = _Entries[lo + (hi - lo) / 2].key, c = _Entries[hi - 1].key;
+				unsigned long long pivot = std::max(std::min(a, b), std::min(std::max(a, b), c));
+
+				size_t lt = lo, i = lo, gt = hi;
+				while (i < gt) {
+					unsigned long long key = _Entries[i].key;
+					if (key < pivot) std::swap(_Entries[lt++], _Entries[i++]);
+					else if (key > pivot) std::swap(_Entries[i], _Entries[--gt]);
+					else i++;
+				}
+				// Within the equal range, strings ending inside this chunk sort first, shortest first.
+				size_t next = depth + Units, mid = lt;
+				for (size_t j = lt; j < gt; j++) {
+					if (_Strs[_Entries[j].index].size() <= next) std::swap(_Entries[mid++], _Entries[j]);
+				}
+				for (size_t j = lt + 1; j < mid; j++) {
+					Entry e = _Entries[j];
+					size_t k = j;
+					for (; k > lt && _Strs[_Entries[k - 1].index].size() > _Strs[e.index].size(); k--)
+						_Entries[k] = _Entries[k - 1];
+					_Entries[k] = e;
+				}
+
+				for (size_t j = mid; j < gt; j++)
+					_Entries[j].key = chunk(_Strs[_Entries[j].index], next);
+
+				// Recurse into the two smaller parts and loop on the largest, so the stack stays O(log n).
+				size_t below = lt - lo, equal = gt - mid, above = hi - gt;
+				if (equal >= below && equal >= above) {
+					sort(lo, lt, depth, rounds);
+					sort(gt, hi, depth, rounds);
+					lo = mid;
+					hi = gt;
+					depth = next;
+					rounds = depth_limit(equal);
+				}
+				else {
+					sort(mid, gt, next, depth_limit(equal));
+					if (below >= above) {
+						sort(gt, hi, depth, rounds);
+						hi = lt;
+					}
+					else {
+						sort(lo, lt, depth, rounds);
+						lo = gt;
+					}
+				}
+			}
+			insertion_sort(lo, hi, depth);
+		}
+
+		// Split by splitters sampled from the first chunks, then let the workers pull buckets.
+		void sort_parallel(size_t workers) {
+			size_t n = _Entries.size(), buckets = workers * 4;
+			std::vector<unsigned long long> sample;
+			size_t stride = std::max((size_t)1, n / (buckets * 32));
+			for (size_t i = 0; i < n; i += stride)
+				sample.push_back(_Entries[i].key);
+			std::sort(sample.begin(), sample.end());
+
+			std::vector<unsigned long long> splitters;
+			for (size_t b = 1; b < buckets; b++) {
+				unsigned long long key = sample[b * sample.size() / buckets];
+				if (splitters.empty() || key > splitters.back()) splitters.push_back(key);
+			}
+
+			std::vector<size_t> bucketOf(n), starts(splitters.size() + 2, 0);
+			for (size_t i = 0; i < n; i++) {
+				bucketOf[i] = std::upper_bound(splitters.begin(), splitters.end(), _Entries[i].key) - splitters.begin();
+				starts[bucketOf[i] + 1]++;
+			}
+			for (size_t b = 1; b < starts.size(); b++)
+				starts[b] += starts[b - 1];
+
+			std::vector<Entry> scattered(n);
+			std::vector<size_t> fill(starts.begin(), starts.end() - 1);
+			for (size_t i = 0; i < n; i++)
+				scattered[fill[bucketOf[i]]++] = _Entries[i];
+			_Entries.swap(scattered);
+
+			std::atomic<size_t> next(0);
+			size_t count = starts.size() - 1;
+			ParallelHelper::for_ranges(workers, workers, [&](size_t, size_t) {
+				for (size_t b = next++; b < count; b = next++)
+					sort(starts[b], starts[b + 1], 0, depth_limit(starts[b + 1] - starts[b]));
+			});
+		}
+
+		std::vector<TStr>& _Strs;
+		std::vector<Entry> _Entries;
+		bool _IgnoreCase;
+		const CaseContext* _Ctx;
+	};
+
+	class StringJoinHelper {
+	public:
+		// Results smaller than this per worker are copied on one thread.
+		enum { MinBytesPerThread = 1 << 20 };
+
+		template<typename TStr, typename TIter>
+		static void join_into(TStr& dst, TIter first, TIter last, const TStr& sep) {
+			typedef typename TStr::traits_type Traits;
+
+			size_t count = 0, total = 0;
+			for (TIter it = first; it != last; ++it, ++count)
+				total += it->size();
+			if (count == 0) return;
+			total += sep.size() * (count - 1);
+
+			size_t pos = dst.size();
+			dst.resize(pos + total);
+			typename TStr::value_type* out = &dst[0] + pos;
+			for (TIter it = first; it != last; ++it) {
+				if (it != first) {
+					Traits::copy(out, sep.data(), sep.size());
+					out += sep.size();
+				}
+				Traits::copy(out, it->data(), it->size());
+				out += it->size();
+			}
+		}
+
+		template<typename TStr, typename TElem>
+		static void join_into(TStr& dst, const std::vector<TElem>& strArray, const TStr& sep, size_t threads) {
+			typedef typename TStr::traits_type Traits;
+
+			size_t count = strArray.size();
+			if (count == 0) return;
+
+			// Output offset of every element, so workers can copy disjoint segments.
+			std::vector<size_t> offsets(count + 1);
+			size_t total = 0;
+			for (size_t i = 0; i < count; i++) {
+				offsets[i] = total;
+				total += strArray[i].size() + sep.size();
+			}
+			total -= sep.size();
+			offsets[count] = total;
+
+			size_t workers = ParallelHelper::worker_count(total, threads, MinBytesPerThread);
+			if (workers <= 1) {
+				join_into(dst, strArray.begin(), strArray.end(), sep);
+				return;
+			}
+
+			size_t pos = dst.size();
+			dst.resize(pos + total);
+			typename TStr::value_type* out = &dst[0] + pos;
+			ParallelHelper::for_ranges(count, workers, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					Traits::copy(out + offsets[i], strArray[i].data(), strArray[i].size());
+					if (i + 1 < count)
+						Traits::copy(out + offsets[i] + strArray[i].size(), sep.data(), sep.size());
+				}
+			});
+		}
+	};
+
+	class StringReplaceHelper {
+	public:
+		template<typename TStr>
+		static size_t replace_copy(const TStr& src, TStr& dst, const TStr& from, const TStr& to, bool ignoreCase, const CaseContext& ctx) {
+			typedef typename TStr::traits_type Traits;
+
+			std::vector<size_t> matches;
+			if (!from.empty()) {
+				for (size_t pos = StringCompareHelper::find(src, from, 0, ignoreCase, ctx); pos != TStr::npos;
+					pos = StringCompareHelper::find(src, from, pos + from.size(), ignoreCase, ctx))
+					matches.push_back(pos);
+			}
+
+			dst.resize(src.size() + matches.size() * to.size() - matches.size() * from.size());
+			if (dst.empty()) return matches.size();
+
+			typename TStr::value_type* out = &dst[0];
+			size_t last = 0;
+			for (size_t i = 0; i < matches.size(); i++) {
+				Traits::copy(out, src.data() + last, matches[i] - last);
+				out += matches[i] - last;
+				Traits::copy(out, to.data(), to.size());
+				out += to.size();
+				last = matches[i] + from.size();
+			}
+			Traits::copy(out, src.data() + last, src.size() - last);
+			return matches.size();
+		}
+
+		template<typename TStr>
+		static size_t replace(TStr& src, const TStr& from, const TStr& to, bool ignoreCase, const CaseContext& ctx) {
+			typedef typename TStr::traits_type Traits;
+
+			if (from.empty()) return 0;
+
+			if (to.size() > from.size()) {
+				TStr dst;
+				size_t count = replace_copy(src, dst, from, to, ignoreCase, ctx);
+				if (count > 0) src.swap(dst);
+				return count;
+			}
+
+			// The output never overtakes the input, so compact in place.
+			size_t count = 0, read = 0, write = 0;
+			for (size_t pos = StringCompareHelper::find(src, from, 0, ignoreCase, ctx); pos != TStr::npos;
+				pos = StringCompareHelper::find(src, from, read, ignoreCase, ctx)) {
+				Traits::move(&src[0] + write, src.data() + read, pos - read);
+				write += pos - read;
+				Traits::copy(&src[0] + write, to.data(), to.size());
+				write += to.size();
+				read = pos + from.size();
+				count++;
+			}
+			if (count > 0 && write != read) {
+				Traits::move(&src[0] + write, src.data() + read, src.size() - read);
+				src.resize(write + src.size() - read);
+			}
+			return count;
+		}
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	bool cstarts_with(const char* src, const char* dst, bool ignoreCase, const CaseContext& ctx)
+	{
+		return StringCompareHelper::StartsWithC(src, dst, ignoreCase, ctx);
+	}
+
+	bool cends_with(const char* src, const char* dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return StringCompareHelper::EndsWithC(src, dst, ignoreCase, ctx);
+	}
+
+	bool ccontains(const char* src, const char* dst, bool ignoreCase, const CaseContext& ctx)
+	{
+		return StringCompareHelper::ContainsC(src, dst, ignoreCase, ctx);
+	}
+	//////////////////////////////////////////////////////////////////////////
+	void trim(std::string& src) {
+		StringTrimHelper::trim(src, SpaceChars());
+	}
+
+	void trim(std::wstring& src) {
+		StringTrimHelper::trim(src, SpaceChars());
+	}
+
+	void trim(const std::string& src, std::string& dst) {
+		StringTrimHelper::trim_copy(src, dst, SpaceChars());
+	}
+
+	void trim(const std::wstring& src, std::wstring& dst) {
+		StringTrimHelper::trim_copy(src, dst, SpaceChars());
+	}
+
+	void trim(const std::string& src, std::string& dst, const std::string& trimChars) {
+		StringTrimHelper::trim_copy(src, dst, trimChars);
+	}
+
+	void trim(const std::wstring& src, std::wstring& dst, const std::wstring& trimChars) {
+		StringTrimHelper::trim_copy(src, dst, trimChars);
+	}
+
+	std::string  trim_copy(const std::string& src) {
+		return StringTrimHelper::trim_copy(src, SpaceChars());
+	}
+
+	std::wstring trim_copy(const std::wstring& src) {
+		return StringTrimHelper::trim_copy(src, SpaceChars());
+	}
+
+	std::string trim_copy(const std::string& src, const std::string& trimChars) {
+		return StringTrimHelper::trim_copy(src, trimChars);
+	}
+
+	std::wstring trim_copy(const std::wstring& src, const std::wstring& trimChars) {
+		return StringTrimHelper::trim_copy(src, trimChars);
+	}
+
+	void trim_start(std::string& src) {
+		StringTrimHelper::trim_start(src, SpaceChars());
+	}
+
+	void trim_start(std::wstring& src) {
+		StringTrimHelper::trim_start(src, SpaceChars());
+	}
+
+	void trim_start(const std::string& src, std::string& dst) {
+		StringTrimHelper::trim_start_copy(src, dst, SpaceChars());
+	}
+
+	void trim_start(const std::wstring& src, std::wstring& dst) {
+		StringTrimHelper::trim_start_copy(src, dst, SpaceChars());
+	}
+
+	void trim_start(const std::string& src, std::string& dst, const std::string& trimChars) {
+		StringTrimHelper::trim_start_copy(src, dst, trimChars);
+	}
+
+	void trim_start(const std::wstring& src, std::wstring& dst, const std::wstring& trimChars) {
+		StringTrimHelper::trim_start_copy(src, dst, trimChars);
+	}
+
+	std::string  trim_start_copy(const std::string& src) {
+		return StringTrimHelper::trim_start_copy(src, SpaceChars());
+	}
+
+	std::wstring trim_start_copy(const std::wstring& src) {
+		return StringTrimHelper::trim_start_copy(src, SpaceChars());
+	}
+
+	std::string trim_start_copy(const std::string& src, const std::string& trimChars) {
+		return StringTrimHelper::trim_start_copy(src, trimChars);
+	}
+
+	std::wstring trim_start_copy(const std::wstring& src, const std::wstring& trimChars) {
+		return StringTrimHelper::trim_start_copy(src, trimChars);
+	}
+
+	void trim_end(std::string& src) {
+		StringTrimHelper::trim_end(src, SpaceChars());
+	}
 
 	void trim_end(std::wstring& src) {
-		StringTrimHelper::trim_end(src, CxWTrimChars);
+		StringTrimHelper::trim_end(src, SpaceChars());
 	}
 
 	void trim_end(const std::string& src, std::string& dst) {
-		StringTrimHelper::trim_end_copy(src, dst, CxTrimChars);
+		StringTrimHelper::trim_end_copy(src, dst, SpaceChars());
 	}
 
 	void trim_end(const std::wstring& src, std::wstring& dst) {
-		StringTrimHelper::trim_end_copy(src, dst, CxWTrimChars);
+		StringTrimHelper::trim_end_copy(src, dst, SpaceChars());
 	}
 
 	void trim_end(const std::string& src, std::string& dst, const std::string& trimChars) {
@@ -385,11 +1779,11 @@ namespace cx {
 	}
 
 	std::string  trim_end_copy(const std::string& src) {
-		return StringTrimHelper::trim_end_copy(src, CxTrimChars);
+		return StringTrimHelper::trim_end_copy(src, SpaceChars());
 	}
 
 	std::wstring trim_end_copy(const std::wstring& src) {
-		return StringTrimHelper::trim_end_copy(src, CxWTrimChars);
+		return StringTrimHelper::trim_end_copy(src, SpaceChars());
 	}
 
 	std::string trim_end_copy(const std::string& src, const std::string& trimChars) {
@@ -400,162 +1794,3271 @@ namespace cx {
 		return StringTrimHelper::trim_end_copy(src, trimChars);
 	}
 
-	bool equals(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/)
+	void normalize_space(std::string& src) {
+		SpaceNormalizeHelper<std::string::value_type>(std::string(CX_TRIM_CHARS)).run(src);
+	}
+
+	void normalize_space(const std::string& src, std::string& dst) {
+		normalize_space(src, dst, std::string(CX_TRIM_CHARS));
+	}
+
+	void normalize_space(const std::string& src, std::string& dst, const std::string& spaceChars) {
+		if (&dst != &src) dst = src;
+		SpaceNormalizeHelper<std::string::value_type>(spaceChars).run(dst);
+	}
+
+	std::string normalize_space_copy(const std::string& src) {
+		std::string dst;
+		normalize_space(src, dst, std::string(CX_TRIM_CHARS));
+		return dst;
+	}
+
+	std::string normalize_space_copy(const std::string& src, const std::string& spaceChars) {
+		std::string dst;
+		normalize_space(src, dst, spaceChars);
+		return dst;
+	}
+
+	void normalize_space(std::wstring& src) {
+		SpaceNormalizeHelper<std::wstring::value_type>(std::wstring(CX_WTRIM_CHARS)).run(src);
+	}
+
+	void normalize_space(const std::wstring& src, std::wstring& dst) {
+		normalize_space(src, dst, std::wstring(CX_WTRIM_CHARS));
+	}
+
+	void normalize_space(const std::wstring& src, std::wstring& dst, const std::wstring& spaceChars) {
+		if (&dst != &src) dst = src;
+		SpaceNormalizeHelper<std::wstring::value_type>(spaceChars).run(dst);
+	}
+
+	std::wstring normalize_space_copy(const std::wstring& src) {
+		std::wstring dst;
+		normalize_space(src, dst, std::wstring(CX_WTRIM_CHARS));
+		return dst;
+	}
+
+	std::wstring normalize_space_copy(const std::wstring& src, const std::wstring& spaceChars) {
+		std::wstring dst;
+		normalize_space(src, dst, spaceChars);
+		return dst;
+	}
+
+	bool equals(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		if (src.length() != dst.length()) return false;
+
+		return StringCompareHelper::equals(src, dst, ignoreCase, ctx);
+	}
+
+	bool equals(const std::wstring& src, const std::wstring& dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		if (src.length() != dst.length()) return false;
+
+		return StringCompareHelper::equals(src, dst, ignoreCase, ctx);
+	}
+
+	int compare(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return SortKeyHelper::compare(src, dst, ignoreCase, ctx);
+	}
+
+	int compare_natural(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return SortKeyHelper::compare_natural(src, dst, ignoreCase, ctx);
+	}
+
+	std::string make_sort_key(const std::string& src, bool ignoreCase /*= false*/, bool natural /*= false*/, const CaseContext& ctx)
+	{
+		return SortKeyHelper::make_key(src, ignoreCase, natural, ctx);
+	}
+
+	int compare(const std::wstring& src, const std::wstring& dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return SortKeyHelper::compare(src, dst, ignoreCase, ctx);
+	}
+
+	int compare_natural(const std::wstring& src, const std::wstring& dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return SortKeyHelper::compare_natural(src, dst, ignoreCase, ctx);
+	}
+
+	std::string make_sort_key(const std::wstring& src, bool ignoreCase /*= false*/, bool natural /*= false*/, const CaseContext& ctx)
+	{
+		return SortKeyHelper::make_key(src, ignoreCase, natural, ctx);
+	}
+
+	bool starts_with(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return StringCompareHelper::starts_with(src, dst, ignoreCase, ctx);
+	}
+
+	bool starts_with(const std::wstring& src, const std::wstring& dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return StringCompareHelper::starts_with(src, dst, ignoreCase, ctx);
+	}
+
+	bool ends_with(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return StringCompareHelper::ends_with(src, dst, ignoreCase, ctx);
+	}
+
+	bool ends_with(const std::wstring& src, const std::wstring& dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return StringCompareHelper::ends_with(src, dst, ignoreCase, ctx);
+	}
+
+	bool contains(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return StringCompareHelper::contains(src, dst, ignoreCase, ctx);
+	}
+
+	bool contains(const std::wstring& src, const std::wstring& dst, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return StringCompareHelper::contains(src, dst, ignoreCase, ctx);
+	}
+
+	bool contains_approx(const std::string& src, const std::string& needle, size_t k, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return ApproxMatcher(needle, ignoreCase, ctx).contains(src, k);
+	}
+
+	size_t replace_all(std::string& src, const std::string& from, const std::string& to, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return StringReplaceHelper::replace(src, from, to, ignoreCase, ctx);
+	}
+
+	size_t replace_all(std::wstring& src, const std::wstring& from, const std::wstring& to, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		return StringReplaceHelper::replace(src, from, to, ignoreCase, ctx);
+	}
+
+	std::string replace_all_copy(const std::string& src, const std::string& from, const std::string& to, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		std::string dst;
+		StringReplaceHelper::replace_copy(src, dst, from, to, ignoreCase, ctx);
+		return dst;
+	}
+
+	std::wstring replace_all_copy(const std::wstring& src, const std::wstring& from, const std::wstring& to, bool ignoreCase /*= false*/, const CaseContext& ctx)
+	{
+		std::wstring dst;
+		StringReplaceHelper::replace_copy(src, dst, from, to, ignoreCase, ctx);
+		return dst;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	Replacer::Replacer(bool ignoreCase /*= false*/, const CaseContext& ctx) : _IgnoreCase(ignoreCase), _Ctx(&ctx), _ShrinkOnly(true)
+	{
+		memset(_First, 0, sizeof(_First));
+	}
+
+	Replacer& Replacer::add(const std::string& from, const std::string& to)
+	{
+		if (from.empty()) return *this;
+
+		_Pairs.push_back(std::make_pair(from, to));
+		if (to.size() > from.size()) _ShrinkOnly = false;
+
+		// Candidates for a first byte are kept longest first, so the longest match wins.
+		unsigned char first = fold(from[0]);
+		_First[first] = 1;
+		std::vector<size_t>& candidates = _ByFirst[first];
+		size_t idx = _Pairs.size() - 1;
+		std::vector<size_t>::iterator it = candidates.begin();
+		while (it != candidates.end() && _Pairs[*it].first.size() >= from.size()) ++it;
+		candidates.insert(it, idx);
+
+		if (_IgnoreCase) {
+			_First[(unsigned char)_Ctx->to_lower(from[0])] = 1;
+			_First[(unsigned char)_Ctx->to_upper(from[0])] = 1;
+		}
+		return *this;
+	}
+
+	size_t Replacer::match(const char* s, size_t n, size_t& pairIdx) const
+	{
+		const std::vector<size_t>& candidates = _ByFirst[fold(s[0])];
+		for (size_t i = 0; i < candidates.size(); i++) {
+			const std::string& from = _Pairs[candidates[i]].first;
+			if (from.size() > n) continue;
+			bool same = _IgnoreCase
+				? std::equal(from.begin(), from.end(), s, StringCompareHelper::IsIEqual(*_Ctx))
+				: memcmp(from.data(), s, from.size()) == 0;
+			if (same) {
+				pairIdx = candidates[i];
+				return from.size();
+			}
+		}
+		return 0;
+	}
+
+	size_t Replacer::apply(const std::string& src, std::string& dst) const
+	{
+		std::vector<std::pair<size_t, size_t> > matches;	// (position, pair index)
+		size_t outSize = src.size();
+		const char* s = src.data();
+		for (size_t i = 0; i < src.size();) {
+			size_t pairIdx, len;
+			if (_First[(unsigned char)s[i]] && (len = match(s + i, src.size() - i, pairIdx)) > 0) {
+				matches.push_back(std::make_pair(i, pairIdx));
+				outSize = outSize - len + _Pairs[pairIdx].second.size();
+				i += len;
+			}
+			else {
+				i++;
+			}
+		}
+
+		dst.resize(outSize);
+		if (outSize == 0) return matches.size();
+
+		char* out = &dst[0];
+		size_t last = 0;
+		for (size_t i = 0; i < matches.size(); i++) {
+			const std::pair<std::string, std::string>& p = _Pairs[matches[i].second];
+			memcpy(out, s + last, matches[i].first - last);
+			out += matches[i].first - last;
+			memcpy(out, p.second.data(), p.second.size());
+			out += p.second.size();
+			last = matches[i].first + p.first.size();
+		}
+		memcpy(out, s + last, src.size() - last);
+		return matches.size();
+	}
+
+	size_t Replacer::apply(std::string& src) const
+	{
+		if (!_ShrinkOnly) {
+			std::string dst;
+			size_t count = apply(src, dst);
+			if (count > 0) src.swap(dst);
+			return count;
+		}
+
+		// No replacement is longer than its match, so compact in place.
+		size_t count = 0, write = 0;
+		for (size_t read = 0; read < src.size();) {
+			size_t pairIdx, len;
+			if (_First[(unsigned char)src[read]] && (len = match(src.data() + read, src.size() - read, pairIdx)) > 0) {
+				const std::string& to = _Pairs[pairIdx].second;
+				memcpy(&src[write], to.data(), to.size());
+				write += to.size();
+				read += len;
+				count++;
+			}
+			else {
+				src[write++] = src[read++];
+			}
+		}
+		src.resize(write);
+		return count;
+	}
+
+	std::string Replacer::apply_copy(const std::string& src) const
+	{
+		std::string dst;
+		apply(src, dst);
+		return dst;
+	}
+
+	void to_lower(std::string& src, const CaseContext& ctx) {
+		StringCaseHelper::to_lower(src, ctx);
+	}
+
+	void to_lower(std::wstring& src, const CaseContext& ctx) {
+		StringCaseHelper::to_lower(src, ctx);
+	}
+
+	void to_lower(const std::string& src, std::string& dst, const CaseContext& ctx) {
+		StringCaseHelper::to_lower_copy(src, dst, ctx);
+	}
+
+	void to_lower(const std::wstring& src, std::wstring& dst, const CaseContext& ctx) {
+		StringCaseHelper::to_lower_copy(src, dst, ctx);
+	}
+
+	std::string  to_lower_copy(const std::string& src, const CaseContext& ctx) {
+		return StringCaseHelper::to_lower_copy(src, ctx);
+	}
+
+	std::wstring to_lower_copy(const std::wstring& src, const CaseContext& ctx) {
+		return StringCaseHelper::to_lower_copy(src, ctx);
+	}
+
+	void to_upper(std::string& src, const CaseContext& ctx) {
+		StringCaseHelper::to_upper(src, ctx);
+	}
+
+	void to_upper(std::wstring& src, const CaseContext& ctx) {
+		StringCaseHelper::to_upper(src, ctx);
+	}
+
+	void to_upper(const std::string& src, std::string& dst, const CaseContext& ctx) {
+		StringCaseHelper::to_upper_copy(src, dst, ctx);
+	}
+
+	void to_upper(const std::wstring& src, std::wstring& dst, const CaseContext& ctx) {
+		StringCaseHelper::to_upper_copy(src, dst, ctx);
+	}
+
+	std::string  to_upper_copy(const std::string& src, const CaseContext& ctx) {
+		return StringCaseHelper::to_upper_copy(src, ctx);
+	}
+
+	std::wstring to_upper_copy(const std::wstring& src, const CaseContext& ctx) {
+		return StringCaseHelper::to_upper_copy(src, ctx);
+	}
+
+	void utf8_to_lower(std::string& src) {
+		Utf8CaseHelper::convert(src, Utf8CaseHelper::Lower);
+	}
+
+	void utf8_to_lower(const std::string& src, std::string& dst) {
+		Utf8CaseHelper::convert(src, dst, Utf8CaseHelper::Lower);
+	}
+
+	std::string utf8_to_lower_copy(const std::string& src) {
+		std::string dst;
+		Utf8CaseHelper::convert(src, dst, Utf8CaseHelper::Lower);
+		return dst;
+	}
+
+	void utf8_to_upper(std::string& src) {
+		Utf8CaseHelper::convert(src, Utf8CaseHelper::Upper);
+	}
+
+	void utf8_to_upper(const std::string& src, std::string& dst) {
+		Utf8CaseHelper::convert(src, dst, Utf8CaseHelper::Upper);
+	}
+
+	std::string utf8_to_upper_copy(const std::string& src) {
+		std::string dst;
+		Utf8CaseHelper::convert(src, dst, Utf8CaseHelper::Upper);
+		return dst;
+	}
+
+	void utf8_fold_case(const std::string& src, std::string& dst) {
+		Utf8CaseHelper::convert(src, dst, Utf8CaseHelper::Fold);
+	}
+
+	bool utf8_equals(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/)
+	{
+		if (!ignoreCase) return src == dst;
+
+		return Utf8CaseHelper::fold_match(src, dst, true);
+	}
+
+	bool utf8_starts_with(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/)
+	{
+		if (!ignoreCase) return src.compare(0, dst.size(), dst) == 0;
+
+		return Utf8CaseHelper::fold_match(src, dst, false);
+	}
+
+	bool utf8_contains(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/)
+	{
+		if (!ignoreCase) return src.find(dst) != std::string::npos;
+
+		std::string foldedSrc, foldedDst;
+		Utf8CaseHelper::convert(src, foldedSrc, Utf8CaseHelper::Fold);
+		Utf8CaseHelper::convert(dst, foldedDst, Utf8CaseHelper::Fold);
+		return foldedSrc.find(foldedDst) != std::string::npos;
+	}
+
+	bool utf8_to_wide(const char* src, size_t srcLen, wchar_t* dst, size_t& dstLen)
+	{
+		return Utf8Transcoder<wchar_t>::from_utf8(src, srcLen, dst, dstLen);
+	}
+
+	bool wide_to_utf8(const wchar_t* src, size_t srcLen, char* dst, size_t& dstLen)
+	{
+		return Utf8Transcoder<wchar_t>::to_utf8(src, srcLen, dst, dstLen);
+	}
+
+	bool utf8_to_utf16(const char* src, size_t srcLen, char16_t* dst, size_t& dstLen)
+	{
+		return Utf8Transcoder<char16_t>::from_utf8(src, srcLen, dst, dstLen);
+	}
+
+	bool utf16_to_utf8(const char16_t* src, size_t srcLen, char* dst, size_t& dstLen)
+	{
+		return Utf8Transcoder<char16_t>::to_utf8(src, srcLen, dst, dstLen);
+	}
+
+	bool utf8_to_wide(const std::string& src, std::wstring& dst)
+	{
+		size_t len = src.size();
+		dst.resize(len);
+		if (len > 0 && !utf8_to_wide(src.data(), src.size(), &dst[0], len)) {
+			dst.clear();
+			return false;
+		}
+		dst.resize(len);
+		return true;
+	}
+
+	bool wide_to_utf8(const std::wstring& src, std::string& dst)
+	{
+		size_t len = src.size() * (sizeof(wchar_t) == 2 ? 3 : 4);
+		dst.resize(len);
+		if (len > 0 && !wide_to_utf8(src.data(), src.size(), &dst[0], len)) {
+			dst.clear();
+			return false;
+		}
+		dst.resize(len);
+		return true;
+	}
+
+	class StringSplitHelper {
+	public:
+		// Get the field starting at pos and move pos past its separator; pos beyond the end means done.
+		template<class TStr>
+		static bool next_field(const TStr& s, const TStr& sep, size_t& pos, size_t& begin, size_t& end) {
+			if (pos > s.size()) return false;
+
+			begin = pos;
+			end = s.find_first_of(sep, pos);
+			if (end == TStr::npos) end = s.size();
+			pos = end + 1;
+			return true;
+		}
+
+		template<class TStr>
+		static void split_n(const TStr& s, const TStr& sep, size_t maxParts, std::vector<TStr>& strArray, bool excludeEmpty, bool trimStr) {
+			strArray.clear();
+			if (s.empty()) return;
+
+			size_t pos = 0, begin, end;
+			while (maxParts == 0 || strArray.size() + 1 < maxParts) {
+				if (!next_field(s, sep, pos, begin, end)) return;
+				if (excludeEmpty && begin == end) continue;
+
+				strArray.push_back(s.substr(begin, end - begin));
+				if (trimStr) cx::trim(strArray.back());
+			}
+
+			if (excludeEmpty) {
+				while (pos < s.size() && sep.find(s[pos]) != TStr::npos) pos++;
+				if (pos >= s.size()) return;
+			}
+			else if (pos > s.size()) {
+				return;
+			}
+
+			strArray.push_back(s.substr(pos));
+			if (trimStr) cx::trim(strArray.back());
+		}
+
+		template<class TStr>
+		static bool field_at(const TStr& s, const TStr& sep, size_t index, TStr& field, bool excludeEmpty, bool trimStr) {
+			if (s.empty()) return false;
+
+			size_t pos = 0, begin, end, n = 0;
+			while (next_field(s, sep, pos, begin, end)) {
+				if (excludeEmpty && begin == end) continue;
+				if (n++ == index) {
+					field.assign(s, begin, end - begin);
+					if (trimStr) cx::trim(field);
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+
+	// from stl_string.h
+	template <class _TStr, class _TIter>
+	static void split_str(const _TStr& s, _TIter iter, const _TStr& sep, bool exceptEmpty = false, bool trimStr = false)
+	{
+		_TStr dst;
+
+		if (s.size() == 0)
+			return;
+
+		for (size_t i = 0; i < s.size(); i++)
+		{
+			size_t id = sep.find(s[i]);
+			if (id != _TStr::npos)
+			{
+				if (!exceptEmpty || dst.size() > 0)
+				{
+					if (trimStr) cx::trim(dst);
+					*iter = dst;
+					dst.resize(0);
+				}
+			}
+			else
+			{
+				dst += s[i];
+			}
+		}
+
+		if (!exceptEmpty || dst.size() > 0)
+		{
+			if (trimStr) cx::trim(dst);
+			*iter = dst;
+		}
+	}
+
+	// Wide form of split_str, jumping between separators with a vector scan.
+	template<typename _TIter>
+	static void split_str(const std::wstring& s, _TIter iter, const std::wstring& sep, bool exceptEmpty = false, bool trimStr = false)
+	{
+		std::wstring dst;
+
+		if (s.size() == 0)
+			return;
+
+		for (size_t i = 0; ; )
+		{
+			size_t end = i + WideFindAny(s.data() + i, s.size() - i, sep.data(), sep.size());
+			if (!exceptEmpty || end > i)
+			{
+				dst.assign(s, i, end - i);
+				if (trimStr) cx::trim(dst);
+				*iter = dst;
+			}
+			if (end == s.size()) break;
+			i = end + 1;
+		}
+	}
+
+	void split(const std::string& s, const std::string& sep, std::vector<std::string>& strArray, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	{
+		strArray.clear();
+		split_str(s, std::back_insert_iterator<std::vector<std::string> >(strArray), sep, excludeEmpty, trimStr);
+	}
+
+	void split(const std::wstring& s, const std::wstring& sep, std::vector<std::wstring>& strArray, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	{
+		strArray.clear();
+		split_str(s, std::back_insert_iterator<std::vector<std::wstring> >(strArray), sep, excludeEmpty, trimStr);
+	}
+
+	void split(const std::string& s, const std::string& sep, std::list<std::string>& strList, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	{
+		strList.clear();
+		split_str(s, std::back_insert_iterator<std::list<std::string> >(strList), sep, excludeEmpty, trimStr);
+	}
+
+	void split(const std::wstring& s, const std::wstring& sep, std::list<std::wstring>& strList, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	{
+		strList.clear();
+		split_str(s, std::back_insert_iterator<std::list<std::wstring> >(strList), sep, excludeEmpty, trimStr);
+	}
+
+	void split_n(const std::string& s, const std::string& sep, size_t maxParts, std::vector<std::string>& strArray, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	{
+		StringSplitHelper::split_n(s, sep, maxParts, strArray, excludeEmpty, trimStr);
+	}
+
+	void split_n(const std::wstring& s, const std::wstring& sep, size_t maxParts, std::vector<std::wstring>& strArray, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	{
+		StringSplitHelper::split_n(s, sep, maxParts, strArray, excludeEmpty, trimStr);
+	}
+
+	bool field_at(const std::string& s, const std::string& sep, size_t index, std::string& field, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	{
+		return StringSplitHelper::field_at(s, sep, index, field, excludeEmpty, trimStr);
+	}
+
+	bool field_at(const std::wstring& s, const std::wstring& sep, size_t index, std::wstring& field, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	{
+		return StringSplitHelper::field_at(s, sep, index, field, excludeEmpty, trimStr);
+	}
+
+	std::string join(const std::vector<std::string>& strArray, const std::string& sep)
+	{
+		std::string dst;
+		StringJoinHelper::join_into(dst, strArray.begin(), strArray.end(), sep);
+		return dst;
+	}
+
+	std::wstring join(const std::vector<std::wstring>& strArray, const std::wstring& sep)
+	{
+		std::wstring dst;
+		StringJoinHelper::join_into(dst, strArray.begin(), strArray.end(), sep);
+		return dst;
+	}
+
+	std::string join(const std::list<std::string>& strList, const std::string& sep)
+	{
+		std::string dst;
+		StringJoinHelper::join_into(dst, strList.begin(), strList.end(), sep);
+		return dst;
+	}
+
+	std::wstring join(const std::list<std::wstring>& strList, const std::wstring& sep)
+	{
+		std::wstring dst;
+		StringJoinHelper::join_into(dst, strList.begin(), strList.end(), sep);
+		return dst;
+	}
+
+	std::string join(const std::vector<string_view>& strArray, const std::string& sep)
+	{
+		std::string dst;
+		StringJoinHelper::join_into(dst, strArray.begin(), strArray.end(), sep);
+		return dst;
+	}
+
+	std::wstring join(const std::vector<wstring_view>& strArray, const std::wstring& sep)
+	{
+		std::wstring dst;
+		StringJoinHelper::join_into(dst, strArray.begin(), strArray.end(), sep);
+		return dst;
+	}
+
+	void join_into(std::string& dst, const std::vector<std::string>& strArray, const std::string& sep, size_t threads /*= 1*/)
+	{
+		StringJoinHelper::join_into(dst, strArray, sep, threads);
+	}
+
+	void join_into(std::wstring& dst, const std::vector<std::wstring>& strArray, const std::wstring& sep, size_t threads /*= 1*/)
+	{
+		StringJoinHelper::join_into(dst, strArray, sep, threads);
+	}
+
+	void join_into(std::string& dst, const std::list<std::string>& strList, const std::string& sep)
+	{
+		StringJoinHelper::join_into(dst, strList.begin(), strList.end(), sep);
+	}
+
+	void join_into(std::wstring& dst, const std::list<std::wstring>& strList, const std::wstring& sep)
+	{
+		StringJoinHelper::join_into(dst, strList.begin(), strList.end(), sep);
+	}
+
+	void join_into(std::string& dst, const std::vector<string_view>& strArray, const std::string& sep, size_t threads /*= 1*/)
+	{
+		StringJoinHelper::join_into(dst, strArray, sep, threads);
+	}
+
+	void join_into(std::wstring& dst, const std::vector<wstring_view>& strArray, const std::wstring& sep, size_t threads /*= 1*/)
+	{
+		StringJoinHelper::join_into(dst, strArray, sep, threads);
+	}
+
+	void trim_all(std::vector<std::string>& strArray, size_t threads /*= 1*/)
+	{
+		StringBatchHelper::for_each(strArray, threads, StringBatchHelper::Trimmer());
+	}
+
+	void trim_all(std::vector<std::wstring>& strArray, size_t threads /*= 1*/)
+	{
+		StringBatchHelper::for_each(strArray, threads, StringBatchHelper::Trimmer());
+	}
+
+	void to_lower_all(std::vector<std::string>& strArray, size_t threads, const CaseContext& ctx)
+	{
+		StringBatchHelper::for_each(strArray, threads, StringBatchHelper::Lowerer(ctx));
+	}
+
+	void to_lower_all(std::vector<std::wstring>& strArray, size_t threads, const CaseContext& ctx)
+	{
+		StringBatchHelper::for_each(strArray, threads, StringBatchHelper::Lowerer(ctx));
+	}
+
+	void to_upper_all(std::vector<std::string>& strArray, size_t threads, const CaseContext& ctx)
+	{
+		StringBatchHelper::for_each(strArray, threads, StringBatchHelper::Upperer(ctx));
+	}
+
+	void to_upper_all(std::vector<std::wstring>& strArray, size_t threads, const CaseContext& ctx)
+	{
+		StringBatchHelper::for_each(strArray, threads, StringBatchHelper::Upperer(ctx));
+	}
+
+	bool contains_any_of(const std::vector<std::string>& strArray, const std::string& needle, bool ignoreCase, size_t threads, const CaseContext& ctx)
+	{
+		return StringBatchHelper::contains_any_of(strArray, needle, ignoreCase, threads, ctx);
+	}
+
+	bool contains_any_of(const std::vector<std::wstring>& strArray, const std::wstring& needle, bool ignoreCase, size_t threads, const CaseContext& ctx)
+	{
+		return StringBatchHelper::contains_any_of(strArray, needle, ignoreCase, threads, ctx);
+	}
+
+	void sort_strings(std::vector<std::string>& strArray, bool ignoreCase /*= false*/, size_t threads /*= 1*/, const CaseContext& ctx)
+	{
+		StringSortHelper<std::string::value_type>(strArray, ignoreCase, ctx).run(threads);
+	}
+
+	void sort_strings(std::vector<std::wstring>& strArray, bool ignoreCase /*= false*/, size_t threads /*= 1*/, const CaseContext& ctx)
+	{
+		StringSortHelper<std::wstring::value_type>(strArray, ignoreCase, ctx).run(threads);
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Splits a narrow buffer into views with a separator lookup table, with split_str semantics.
+	class ViewSplitter {
+	public:
+		ViewSplitter(const char* data, size_t len, const std::string& sep) : _Data(data), _Len(len), _Pos(len == 0 ? 1 : 0) {
+			memset(_IsSep, 0, sizeof(_IsSep));
+			for (size_t i = 0; i < sep.size(); i++) _IsSep[(unsigned char)sep[i]] = true;
+		}
+
+		bool next(string_view& field) {
+			if (_Pos > _Len) return false;
+
+			size_t end = _Pos;
+			while (end < _Len && !_IsSep[(unsigned char)_Data[end]]) end++;
+			field = string_view(_Data + _Pos, end - _Pos);
+			_Pos = end + 1;
+			return true;
+		}
+
+		static bool is_trim_char(char c) {
+			return SpaceChars::contains(c);
+		}
+
+		static string_view trim(string_view v) {
+			const char* begin = v.data();
+			const char* end = begin + v.size();
+			while (begin < end && is_trim_char(*begin)) begin++;
+			while (end > begin && is_trim_char(end[-1])) end--;
+			return string_view(begin, end - begin);
+		}
+
+	private:
+		const char* _Data;
+		size_t _Len;
+		size_t _Pos;
+		bool _IsSep[256];
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	class NumberParseHelper {
+	public:
+		static bool is_digit(char c) { return (unsigned char)(c - '0') < 10; }
+
+		// Parse 8 ASCII digits at once; returns false if any of them is not a digit.
+		static bool parse_eight(const char* p, unsigned long long& out) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			(void)p; (void)out;
+			return false;
+#else
+			unsigned long long v;
+			memcpy(&v, p, 8);
+			if ((v & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL ||
+				((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL)
+				return false;
+
+			v = ((v & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+			v = ((v & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+			out = ((v & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+			return true;
+#endif
+		}
+
+		// Accumulate a run of digits into value; returns the number of digits consumed.
+		// overflow is set if the value does not fit in 64 bits.
+		static size_t parse_digits(const char* p, size_t n, unsigned long long& value, bool& overflow) {
+			size_t i = 0;
+			unsigned long long eight;
+			while (n - i >= 8 && value < 100000000000ULL && parse_eight(p + i, eight)) {
+				value = value * 100000000ULL + eight;
+				i += 8;
+			}
+			for (; i < n && is_digit(p[i]); i++) {
+				unsigned int d = (unsigned int)(p[i] - '0');
+				if (value > (std::numeric_limits<unsigned long long>::max() - d) / 10) overflow = true;
+				value = value * 10 + d;
+			}
+			return i;
+		}
+
+		template<typename T>
+		static bool parse(const char* p, size_t n, T& out, std::true_type /*integral*/) {
+			bool negative = false;
+			size_t i = 0;
+			if (i < n && (p[i] == '+' || p[i] == '-')) negative = p[i++] == '-';
+
+			unsigned long long value = 0;
+			bool overflow = false;
+			size_t digits = parse_digits(p + i, n - i, value, overflow);
+			if (digits == 0 || i + digits != n || overflow) return false;
+
+			if (negative) {
+				if (!std::numeric_limits<T>::is_signed && value != 0) return false;
+				if (value > (unsigned long long)std::numeric_limits<T>::max() + 1) return false;
+				out = (T)(0 - value);
+			}
+			else {
+				if (value > (unsigned long long)std::numeric_limits<T>::max()) return false;
+				out = (T)value;
+			}
+			return true;
+		}
+
+		template<typename T>
+		static bool parse(const char* p, size_t n, T& out, std::false_type /*floating*/) {
+			static const double Pow10[] = {
+				1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+				1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+			};
+			// Exactly representable mantissas and powers of ten, so one operation rounds correctly.
+			const unsigned long long maxMantissa = sizeof(T) == sizeof(float) ? (1ULL << 24) : (1ULL << 53);
+			const int maxPow = sizeof(T) == sizeof(float) ? 10 : 22;
+
+			bool negative = false;
+			size_t i = 0;
+			if (i < n && (p[i] == '+' || p[i] == '-')) negative = p[i++] == '-';
+
+			unsigned long long mantissa = 0;
+			bool overflow = false;
+			size_t intDigits = parse_digits(p + i, n - i, mantissa, overflow);
+			i += intDigits;
+
+			size_t fracDigits = 0;
+			if (i < n && p[i] == '.') {
+				i++;
+				fracDigits = parse_digits(p + i, n - i, mantissa, overflow);
+				i += fracDigits;
+			}
+
+			int exponent = 0;
+			if (i < n && (p[i] == 'e' || p[i] == 'E') && intDigits + fracDigits > 0) {
+				size_t j = i + 1;
+				bool negExp = false;
+				if (j < n && (p[j] == '+' || p[j] == '-')) negExp = p[j++] == '-';
+				size_t expStart = j;
+				while (j < n && is_digit(p[j]) && exponent < 100000) exponent = exponent * 10 + (p[j++] - '0');
+				if (j > expStart) {
+					if (negExp) exponent = -exponent;
+					i = j;
+				}
+			}
+			exponent -= (int)fracDigits;
+
+			if (intDigits + fracDigits > 0 && i == n && !overflow && mantissa <= maxMantissa &&
+				exponent >= -maxPow && exponent <= maxPow) {
+				T value = (T)mantissa;
+				value = exponent >= 0 ? value * (T)Pow10[exponent] : value / (T)Pow10[-exponent];
+				out = negative ? -value : value;
+				return true;
+			}
+
+			return parse_slow(p, n, out);
+		}
+
+		// strtod/strtof for the inputs the fast path cannot round exactly, and for inf/nan.
+		template<typename T>
+		static bool parse_slow(const char* p, size_t n, T& out) {
+			// strtod reads the LC_NUMERIC decimal point; the input must use '.', so swap it in.
+			std::string localized;
+			const char* point = CDecimalPoint();
+			if (point[0] != '.' || point[1] != '\0') {
+				size_t pointLen = strlen(point);
+				if (pointLen == 0 || std::search(p, p + n, point, point + pointLen) != p + n) return false;
+				for (size_t i = 0; i < n; i++) {
+					if (p[i] == '.') localized.append(point, pointLen);
+					else localized += p[i];
+				}
+				p = localized.data();
+				n = localized.size();
+			}
+
+			char stackBuf[64];
+			std::string heapBuf;
+			char* buf = stackBuf;
+			if (n >= sizeof(stackBuf)) {
+				heapBuf.assign(p, n);
+				buf = &heapBuf[0];
+			}
+			else {
+				memcpy(stackBuf, p, n);
+				stackBuf[n] = '\0';
+			}
+
+			char* end = NULL;
+			out = sizeof(T) == sizeof(float) ? (T)strtof(buf, &end) : (T)strtod(buf, &end);
+			return n > 0 && end == buf + n;
+		}
+
+		template<typename T>
+		static size_t split_parse(const std::string& s, const std::string& sep, std::vector<T>& values, std::vector<size_t>* badFields, bool excludeEmpty) {
+			values.clear();
+			if (badFields) badFields->clear();
+			if (s.empty()) return 0;
+
+			ViewSplitter splitter(s.data(), s.size(), sep);
+			size_t errors = 0, fieldNo = 0;
+			string_view field;
+			while (splitter.next(field)) {
+				if (excludeEmpty && field.empty()) continue;
+				field = ViewSplitter::trim(field);
+
+				T value = T();
+				if (!parse(field.data(), field.size(), value, typename std::is_integral<T>::type())) {
+					value = T();
+					errors++;
+					if (badFields) badFields->push_back(fieldNo);
+				}
+				values.push_back(value);
+				fieldNo++;
+			}
+			return errors;
+		}
+	};
+
+	template<typename T>
+	size_t split_parse(const std::string& s, const std::string& sep, std::vector<T>& values, std::vector<size_t>* badFields /*= NULL*/, bool excludeEmpty /*= false*/)
+	{
+		return NumberParseHelper::split_parse(s, sep, values, badFields, excludeEmpty);
+	}
+
+	template size_t split_parse<int>(const std::string&, const std::string&, std::vector<int>&, std::vector<size_t>*, bool);
+	template size_t split_parse<long>(const std::string&, const std::string&, std::vector<long>&, std::vector<size_t>*, bool);
+	template size_t split_parse<long long>(const std::string&, const std::string&, std::vector<long long>&, std::vector<size_t>*, bool);
+	template size_t split_parse<unsigned int>(const std::string&, const std::string&, std::vector<unsigned int>&, std::vector<size_t>*, bool);
+	template size_t split_parse<unsigned long>(const std::string&, const std::string&, std::vector<unsigned long>&, std::vector<size_t>*, bool);
+	template size_t split_parse<unsigned long long>(const std::string&, const std::string&, std::vector<unsigned long long>&, std::vector<size_t>*, bool);
+	template size_t split_parse<float>(const std::string&, const std::string&, std::vector<float>&, std::vector<size_t>*, bool);
+	template size_t split_parse<double>(const std::string&, const std::string&, std::vector<double>&, std::vector<size_t>*, bool);
+
+	//////////////////////////////////////////////////////////////////////////
+	// Readers never lock: entries and hash tables are written before they are published with a
+	// release store, and neither moves nor is freed until the pool is destroyed. Only inserts,
+	// which may also grow the table, take the shard mutex.
+	struct InternPool::Shard {
+		enum { BlockSize = 64 * 1024, FirstChunkBits = 6, MaxChunks = 32 };
+
+		struct Entry {
+			string_view str;
+			unsigned int hash;
+		};
+
+		// Open addressing over local id + 1, 0 for empty; replaced tables are kept for late readers.
+		struct Table {
+			explicit Table(size_t n) : mask(n - 1), slots(new std::atomic<unsigned int>[n]) {
+				for (size_t i = 0; i < n; i++) slots[i].store(0, std::memory_order_relaxed);
+			}
+			~Table() { delete[] slots; }
+
+			size_t mask;
+			std::atomic<unsigned int>* slots;
+		};
+
+		Shard() : blockPos(NULL), blockFree(0), count(0), table(new Table(64)) {
+			for (int k = 0; k < MaxChunks; k++) chunks[k].store(NULL, std::memory_order_relaxed);
+		}
+
+		~Shard() {
+			for (size_t i = 0; i < blocks.size(); i++)
+				delete[] blocks[i];
+			for (int k = 0; k < MaxChunks; k++)
+				delete[] chunks[k].load(std::memory_order_relaxed);
+			for (size_t i = 0; i < retired.size(); i++)
+				delete retired[i];
+			delete table.load(std::memory_order_relaxed);
+		}
+
+		// Copy the bytes into the arena; arena memory never moves, so views stay valid.
+		const char* store(const char* data, size_t len) {
+			if (len > BlockSize / 4) {
+				blocks.push_back(new char[len]);
+				memcpy(blocks.back(), data, len);
+				return blocks.back();
+			}
+			if (len > blockFree) {
+				blocks.push_back(new char[BlockSize]);
+				blockPos = blocks.back();
+				blockFree = BlockSize;
+			}
+			char* p = blockPos;
+			if (len > 0) memcpy(p, data, len);
+			blockPos += len;
+			blockFree -= len;
+			return p;
+		}
+
+		// Entries live in chunks of 64, 128, 256, ... so a new chunk never moves the older ones.
+		Entry& entry(size_t local) const {
+			size_t biased = local + ((size_t)1 << FirstChunkBits);
+			unsigned int k = BitScanReverse64(biased) - FirstChunkBits;
+			return chunks[k].load(std::memory_order_acquire)[biased - ((size_t)1 << (k + FirstChunkBits))];
+		}
+
+		// Slot holding the string, or the empty slot where it belongs.
+		size_t probe(const Table& t, const char* data, size_t len, unsigned int hash) const {
+			for (size_t idx = hash & t.mask;; idx = (idx + 1) & t.mask) {
+				unsigned int slot = t.slots[idx].load(std::memory_order_acquire);
+				if (slot == 0) return idx;
+
+				const Entry& e = entry(slot - 1);
+				if (e.hash == hash && e.str.size() == len && (len == 0 || memcmp(e.str.data(), data, len) == 0))
+					return idx;
+			}
+		}
+
+		// Local id of the string, or -1; safe without the lock.
+		long long find(const char* data, size_t len, unsigned int hash) const {
+			const Table& t = *table.load(std::memory_order_acquire);
+			unsigned int slot = t.slots[probe(t, data, len, hash)].load(std::memory_order_acquire);
+			return slot == 0 ? -1 : (long long)slot - 1;
+		}
+
+		// Caller holds the lock and has checked that the string is not pooled.
+		void insert(const char* data, size_t len, unsigned int hash, size_t local) {
+			size_t biased = local + ((size_t)1 << FirstChunkBits);
+			unsigned int k = BitScanReverse64(biased) - FirstChunkBits;
+			Entry* chunk = chunks[k].load(std::memory_order_relaxed);
+			if (chunk == NULL) {
+				chunk = new Entry[(size_t)1 << (k + FirstChunkBits)];
+				chunks[k].store(chunk, std::memory_order_release);
+			}
+			Entry& e = chunk[biased - ((size_t)1 << (k + FirstChunkBits))];
+			e.str = string_view(store(data, len), len);
+			e.hash = hash;
+			count.store(local + 1, std::memory_order_release);
+
+			Table* t = table.load(std::memory_order_relaxed);
+			t->slots[probe(*t, data, len, hash)].store((unsigned int)local + 1, std::memory_order_release);
+			if ((local + 1) * 4 > (t->mask + 1) * 3) grow(t, local + 1);
+		}
+
+		void grow(Table* old, size_t n) {
+			Table* t = new Table((old->mask + 1) * 2);
+			for (size_t i = 0; i < n; i++) {
+				size_t idx = entry(i).hash & t->mask;
+				while (t->slots[idx].load(std::memory_order_relaxed) != 0) idx = (idx + 1) & t->mask;
+				t->slots[idx].store((unsigned int)i + 1, std::memory_order_relaxed);
+			}
+			table.store(t, std::memory_order_release);
+			retired.push_back(old);
+		}
+
+		std::mutex lock;
+		std::vector<char*> blocks;
+		char* blockPos;
+		size_t blockFree;
+		std::atomic<size_t> count;
+		std::atomic<Entry*> chunks[MaxChunks];	// by local id, see entry()
+		std::atomic<Table*> table;
+		std::vector<Table*> retired;
+	};
+
+	const unsigned int InternPool::invalid_id;
+
+	InternPool::InternPool(size_t shardCount /*= 16*/) : _ShardBits(0)
+	{
+		while (_ShardBits < 8 && ((size_t)1 << _ShardBits) < shardCount) _ShardBits++;
+		for (size_t i = 0; i < ((size_t)1 << _ShardBits); i++)
+			_Shards.push_back(new Shard());
+	}
+
+	InternPool::~InternPool()
+	{
+		for (size_t i = 0; i < _Shards.size(); i++)
+			delete _Shards[i];
+	}
+
+	unsigned int InternPool::intern(const char* data, size_t len)
+	{
+		unsigned long long h = HashBytes(data, len);
+		unsigned int shardIdx = (unsigned int)(h >> 56) & ((1U << _ShardBits) - 1);
+		unsigned int hash = (unsigned int)h;
+		Shard& shard = *_Shards[shardIdx];
+
+		long long local = shard.find(data, len, hash);
+		if (local < 0) {
+			std::lock_guard<std::mutex> guard(shard.lock);
+			local = shard.find(data, len, hash);
+			if (local < 0) {
+				local = (long long)shard.count.load(std::memory_order_relaxed);
+				if (local >= ((long long)1 << (32 - _ShardBits)) - 1) return invalid_id;
+				shard.insert(data, len, hash, (size_t)local);
+			}
+		}
+		return ((unsigned int)local << _ShardBits) | shardIdx;
+	}
+
+	unsigned int InternPool::intern(const std::string& s)
+	{
+		return intern(s.data(), s.size());
+	}
+
+	string_view InternPool::intern_view(string_view s)
+	{
+		return view(intern(s.data(), s.size()));
+	}
+
+	bool InternPool::find(string_view s, unsigned int& id) const
+	{
+		unsigned long long h = HashBytes(s.data(), s.size());
+		unsigned int shardIdx = (unsigned int)(h >> 56) & ((1U << _ShardBits) - 1);
+		long long local = _Shards[shardIdx]->find(s.data(), s.size(), (unsigned int)h);
+		if (local < 0) return false;
+
+		id = ((unsigned int)local << _ShardBits) | shardIdx;
+		return true;
+	}
+
+	string_view InternPool::view(unsigned int id) const
+	{
+		const Shard& shard = *_Shards[id & ((1U << _ShardBits) - 1)];
+		size_t local = id >> _ShardBits;
+		return local < shard.count.load(std::memory_order_acquire) ? shard.entry(local).str : string_view();
+	}
+
+	size_t InternPool::size() const
+	{
+		size_t n = 0;
+		for (size_t i = 0; i < _Shards.size(); i++)
+			n += _Shards[i]->count.load(std::memory_order_acquire);
+		return n;
+	}
+
+	void split(const std::string& s, const std::string& sep, InternPool& pool, std::vector<unsigned int>& ids, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	{
+		ids.clear();
+
+		ViewSplitter splitter(s.data(), s.size(), sep);
+		string_view field;
+		while (splitter.next(field)) {
+			if (excludeEmpty && field.empty()) continue;
+			if (trimStr) field = ViewSplitter::trim(field);
+			ids.push_back(pool.intern(field.data(), field.size()));
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	class TokenCountHelper {
+	public:
+		// Open-addressing counts keyed by views into the source buffer.
+		struct Table {
+			Table() : slots(1024, 0) {}
+
+			void add(string_view token, unsigned long long hash, size_t count, bool ignoreCase, const CaseContext& ctx) {
+				size_t mask = slots.size() - 1;
+				size_t idx = (size_t)hash & mask;
+				for (; slots[idx] != 0; idx = (idx + 1) & mask) {
+					size_t i = slots[idx] - 1;
+					if (hashes[i] == hash && same(entries[i].token, token, ignoreCase, ctx)) {
+						entries[i].count += count;
+						return;
+					}
+				}
+
+				slots[idx] = (unsigned int)entries.size() + 1;
+				entries.push_back(TokenCount(token, count));
+				hashes.push_back(hash);
+				if (entries.size() * 2 > slots.size()) grow();
+			}
+
+			void grow() {
+				std::vector<unsigned int> old(slots.size() * 2, 0);
+				old.swap(slots);
+				size_t mask = slots.size() - 1;
+				for (size_t i = 0; i < entries.size(); i++) {
+					size_t idx = (size_t)hashes[i] & mask;
+					while (slots[idx] != 0) idx = (idx + 1) & mask;
+					slots[idx] = (unsigned int)i + 1;
+				}
+			}
+
+			std::vector<TokenCount> entries;	// in order of first occurrence
+			std::vector<unsigned long long> hashes;	// by entry
+			std::vector<unsigned int> slots;	// entry + 1, 0 for empty
+		};
+
+		static bool same(string_view a, string_view b, bool ignoreCase, const CaseContext& ctx) {
+			if (a.size() != b.size()) return false;
+			if (!ignoreCase) return memcmp(a.data(), b.data(), a.size()) == 0;
+
+			const unsigned char* lower = ctx.lower_table();
+			for (size_t i = 0; i < a.size(); i++) {
+				if (lower[(unsigned char)a[i]] != lower[(unsigned char)b[i]]) return false;
+			}
+			return true;
+		}
+
+		// Hash of the token, lowercased into scratch first when ignoring case.
+		static unsigned long long hash(string_view token, bool ignoreCase, const CaseContext& ctx, std::string& scratch) {
+			if (!ignoreCase) return HashBytes(token.data(), token.size());
+
+			const unsigned char* lower = ctx.lower_table();
+			scratch.resize(token.size());
+			for (size_t i = 0; i < token.size(); i++)
+				scratch[i] = (char)lower[(unsigned char)token[i]];
+			return HashBytes(scratch.data(), scratch.size());
+		}
+
+		static void count(const char* p, const char* end, const bool* isSep, bool ignoreCase, const CaseContext& ctx, Table& table) {
+			std::string scratch;
+			while (p < end) {
+				while (p < end && isSep[(unsigned char)*p]) p++;
+				const char* q = p;
+				while (q < end && !isSep[(unsigned char)*q]) q++;
+				if (q > p) {
+					string_view token(p, q - p);
+					table.add(token, hash(token, ignoreCase, ctx, scratch), 1, ignoreCase, ctx);
+				}
+				p = q;
+			}
+		}
+
+		struct MoreFrequent {
+			bool operator()(const TokenCount& a, const TokenCount& b) const {
+				return a.count != b.count ? a.count > b.count : a.token.data() < b.token.data();
+			}
+		};
+	};
+
+	void count_tokens(string_view buffer, const std::string& sep, std::vector<TokenCount>& counts, bool ignoreCase /*= false*/, size_t threads /*= 1*/, size_t topK /*= 0*/, const CaseContext& ctx /*= CaseContext::global()*/)
+	{
+		counts.clear();
+
+		bool isSep[256] = { false };
+		for (size_t i = 0; i < sep.size(); i++) isSep[(unsigned char)sep[i]] = true;
+
+		// Part boundaries move forward to the start of a token, so no token straddles two parts.
+		const char* data = buffer.data();
+		size_t workers = ParallelHelper::worker_count(buffer.size(), threads, 1 << 16);
+		std::vector<size_t> bounds(workers + 1, buffer.size());
+		bounds[0] = 0;
+		for (size_t i = 1; i < workers; i++) {
+			size_t b = std::max(bounds[i - 1], buffer.size() / workers * i);
+			while (b > 0 && b < buffer.size() && !isSep[(unsigned char)data[b - 1]]) b++;
+			bounds[i] = b;
+		}
+
+		std::vector<TokenCountHelper::Table> tables(workers);
+		ParallelHelper::for_ranges(workers, workers, [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++)
+				TokenCountHelper::count(data + bounds[i], data + bounds[i + 1], isSep, ignoreCase, ctx, tables[i]);
+		});
+
+		// Merging in part order keeps the earliest occurrence of every token.
+		TokenCountHelper::Table& merged = tables[0];
+		for (size_t t = 1; t < tables.size(); t++) {
+			const TokenCountHelper::Table& table = tables[t];
+			for (size_t i = 0; i < table.entries.size(); i++)
+				merged.add(table.entries[i].token, table.hashes[i], table.entries[i].count, ignoreCase, ctx);
+		}
+
+		counts.swap(merged.entries);
+		if (topK > 0 && topK < counts.size()) {
+			std::partial_sort(counts.begin(), counts.begin() + topK, counts.end(), TokenCountHelper::MoreFrequent());
+			counts.resize(topK);
+		}
+		else {
+			std::sort(counts.begin(), counts.end(), TokenCountHelper::MoreFrequent());
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	class GlobHelper {
+	public:
+		static void add_char(unsigned long long set[4], unsigned char c) {
+			set[c >> 6] |= 1ULL << (c & 63);
+		}
+
+		static void add_char(unsigned long long set[4], char c, bool ignoreCase, const CaseContext& ctx) {
+			add_char(set, (unsigned char)c);
+			if (ignoreCase) {
+				add_char(set, (unsigned char)ctx.to_lower(c));
+				add_char(set, (unsigned char)ctx.to_upper(c));
+			}
+		}
+
+		static bool test(const unsigned long long* set, char c) {
+			return (set[(unsigned char)c >> 6] >> ((unsigned char)c & 63)) & 1;
+		}
+
+		// Parse the class starting at pattern[i] == '[', advancing i past its ']'.
+		// Leaves set untouched when the class is not closed, so '[' can be taken literally.
+		static bool parse_class(const std::string& pattern, size_t& i, unsigned long long set[4], bool ignoreCase, const CaseContext& ctx) {
+			unsigned long long members[4] = { 0, 0, 0, 0 };
+			size_t n = pattern.size(), j = i + 1;
+			bool negate = j < n && (pattern[j] == '!' || pattern[j] == '^');
+			if (negate) j++;
+
+			size_t start = j;
+			for (; j < n && (pattern[j] != ']' || j == start); j++) {
+				if (pattern[j] == '\\' && j + 1 < n) j++;
+				unsigned char lo = (unsigned char)pattern[j], hi = lo;
+				if (j + 2 < n && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+					j += 2;
+					if (pattern[j] == '\\' && j + 1 < n) j++;
+					hi = (unsigned char)pattern[j];
+				}
+				for (unsigned int c = lo; c <= hi; c++)
+					add_char(members, (char)c, ignoreCase, ctx);
+			}
+			if (j >= n) return false;
+
+			for (int k = 0; k < 4; k++) set[k] = negate ? ~members[k] : members[k];
+			i = j + 1;
+			return true;
+		}
+	};
+
+	Glob::Glob(const std::string& pattern /*= std::string()*/, bool ignoreCase /*= false*/, const CaseContext& ctx)
+		: _Pattern(pattern), _MinLength(0), _IgnoreCase(ignoreCase), _Ctx(&ctx)
+	{
+		Segment seg = { 0, 0, std::string(), true };
+		_Segments.push_back(seg);
+
+		size_t i = 0, n = pattern.size();
+		while (i < n) {
+			unsigned long long set[4] = { 0, 0, 0, 0 };
+			char c = pattern[i];
+			if (c == '*') {
+				while (i < n && pattern[i] == '*') i++;
+				seg.first = _Sets.size() / 4;
+				_Segments.push_back(seg);
+			}
+			else if (c == '?') {
+				set[0] = set[1] = set[2] = set[3] = ~0ULL;
+				add_set(set, c, false);
+				i++;
+			}
+			else if (c == '[' && GlobHelper::parse_class(pattern, i, set, ignoreCase, ctx)) {
+				add_set(set, c, false);
+			}
+			else {
+				if (c == '\\' && i + 1 < n) c = pattern[++i];
+				GlobHelper::add_char(set, c, ignoreCase, ctx);
+				add_set(set, c, true);
+				i++;
+			}
+		}
+	}
+
+	void Glob::add_set(const unsigned long long set[4], char c, bool literal)
+	{
+		_Sets.insert(_Sets.end(), set, set + 4);
+		Segment& seg = _Segments.back();
+		seg.count++;
+		seg.text += c;
+		seg.literal = seg.literal && literal;
+		_MinLength++;
+	}
+
+	bool Glob::match_at(const Segment& seg, const char* p) const
+	{
+		if (seg.literal)
+			return StringCompareHelper::starts_with(string_view(p, seg.count), string_view(seg.text), _IgnoreCase, *_Ctx);
+
+		const unsigned long long* set = &_Sets[seg.first * 4];
+		for (size_t i = 0; i < seg.count; i++, set += 4) {
+			if (!GlobHelper::test(set, p[i])) return false;
+		}
+		return true;
+	}
+
+	size_t Glob::find(const Segment& seg, string_view s, size_t pos) const
+	{
+		if (seg.literal)
+			return StringCompareHelper::find(s, string_view(seg.text), pos, _IgnoreCase, *_Ctx);
+
+		const unsigned long long* first = &_Sets[seg.first * 4];
+		for (; pos + seg.count <= s.size(); pos++) {
+			if (GlobHelper::test(first, s[pos]) && match_at(seg, s.data() + pos)) return pos;
+		}
+		return string_view::npos;
+	}
+
+	bool Glob::match(string_view s) const
+	{
+		const Segment& head = _Segments.front();
+		if (_Segments.size() == 1) return s.size() == head.count && match_at(head, s.data());
+		if (s.size() < _MinLength) return false;
+
+		// Both ends are anchored, only the segments between them float.
+		const Segment& tail = _Segments.back();
+		if (!match_at(head, s.data()) || !match_at(tail, s.data() + s.size() - tail.count)) return false;
+
+		string_view body(s.data(), s.size() - tail.count);
+		size_t pos = head.count;
+		for (size_t i = 1; i + 1 < _Segments.size(); i++) {
+			pos = find(_Segments[i], body, pos);
+			if (pos == string_view::npos) return false;
+			pos += _Segments[i].count;
+		}
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	StreamSearcher::StreamSearcher(bool ignoreCase /*= false*/, const CaseContext& ctx)
+		: _State(0), _Offset(0), _Dirty(true), _IgnoreCase(ignoreCase), _Ctx(&ctx)
+	{
+	}
+
+	StreamSearcher::StreamSearcher(const std::string& needle, bool ignoreCase /*= false*/, const CaseContext& ctx)
+		: _State(0), _Offset(0), _Dirty(true), _IgnoreCase(ignoreCase), _Ctx(&ctx)
+	{
+		add(needle);
+	}
+
+	StreamSearcher::StreamSearcher(const char* needle, bool ignoreCase /*= false*/, const CaseContext& ctx)
+		: _State(0), _Offset(0), _Dirty(true), _IgnoreCase(ignoreCase), _Ctx(&ctx)
+	{
+		if (needle != NULL) add(needle);
+	}
+
+	StreamSearcher& StreamSearcher::add(const std::string& needle)
+	{
+		if (!needle.empty()) {
+			_Needles.push_back(needle);
+			_Dirty = true;
+		}
+		return *this;
+	}
+
+	void StreamSearcher::reset()
+	{
+		_State = 0;
+		_Offset = 0;
+	}
+
+	void StreamSearcher::build()
+	{
+		const size_t npos = (size_t)-1;
+		_Next.assign(256, 0);
+		_Output.assign(1, npos);
+
+		// Trie of the (folded) needles, 0 marks a missing edge.
+		for (size_t k = 0; k < _Needles.size(); k++) {
+			unsigned int state = 0;
+			for (size_t i = 0; i < _Needles[k].size(); i++) {
+				char c = _IgnoreCase ? _Ctx->to_lower(_Needles[k][i]) : _Needles[k][i];
+				unsigned int& next = _Next[state * 256 + (unsigned char)c];
+				if (next == 0) {
+					next = (unsigned int)_Output.size();
+					_Next.resize(_Next.size() + 256, 0);
+					_Output.push_back(npos);
+				}
+				state = _Next[state * 256 + (unsigned char)c];
+			}
+			if (_Output[state] == npos) _Output[state] = k;
+		}
+
+		// Breadth-first, turn missing edges into failure transitions. When a state is
+		// dequeued its own row is untouched, so nonzero entries are still trie children.
+		std::vector<unsigned int> fail(_Output.size(), 0);
+		std::vector<unsigned int> queue(1, 0);
+		_Link.assign(_Output.size(), 0);
+		for (size_t q = 0; q < queue.size(); q++) {
+			unsigned int state = queue[q];
+			unsigned int* row = &_Next[state * 256];
+			const unsigned int* failRow = &_Next[fail[state] * 256];
+			for (int c = 0; c < 256; c++) {
+				unsigned int child = row[c];
+				if (child == 0) {
+					row[c] = state == 0 ? 0 : failRow[c];
+					continue;
+				}
+				fail[child] = state == 0 ? 0 : failRow[c];
+				_Link[child] = _Output[fail[child]] != npos ? fail[child] : _Link[fail[child]];
+				queue.push_back(child);
+			}
+		}
+
+		if (_IgnoreCase) {
+			for (size_t state = 0; state < _Output.size(); state++) {
+				unsigned int* row = &_Next[state * 256];
+				for (int c = 0; c < 256; c++)
+					row[c] = row[(unsigned char)_Ctx->to_lower((char)c)];
+			}
+		}
+
+		_State = 0;
+		_Dirty = false;
+	}
+
+	size_t StreamSearcher::feed(const char* data, size_t len, std::vector<StreamMatch>& matches)
+	{
+		if (_Dirty) build();
+
+		const size_t npos = (size_t)-1;
+		const unsigned int* next = &_Next[0];
+		size_t found = matches.size();
+		unsigned int state = _State;
+		for (size_t i = 0; i < len; i++) {
+			state = next[state * 256 + (unsigned char)data[i]];
+			if (_Output[state] == npos && _Link[state] == 0) continue;
+
+			unsigned long long end = _Offset + i + 1;
+			for (unsigned int t = _Output[state] != npos ? state : _Link[state]; t != 0; t = _Link[t]) {
+				StreamMatch m = { end - _Needles[_Output[t]].size(), _Output[t] };
+				matches.push_back(m);
+			}
+		}
+
+		_State = state;
+		_Offset += len;
+		return matches.size() - found;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	ApproxMatcher::ApproxMatcher(const std::string& needle /*= std::string()*/, bool ignoreCase /*= false*/, const CaseContext& ctx)
+		: _Needle(needle), _IgnoreCase(ignoreCase), _Ctx(&ctx)
+	{
+		memset(_Peq, 0, sizeof(_Peq));
+		if (needle.size() > 64) return;
+
+		for (int c = 0; c < 256; c++) {
+			char folded = ignoreCase ? ctx.to_lower((char)c) : (char)c;
+			for (size_t i = 0; i < needle.size(); i++) {
+				char p = ignoreCase ? ctx.to_lower(needle[i]) : needle[i];
+				if (p == folded) _Peq[c] |= 1ULL << i;
+			}
+		}
+	}
+
+	// Smallest distance seen, returning as soon as it drops to k or below.
+	size_t ApproxMatcher::scan(string_view s, size_t k) const
+	{
+		size_t m = _Needle.size(), best = m;
+		if (best <= k) return best;
+
+		if (m <= 64) {
+			// Myers 1999: vertical delta vectors of the DP column, with a free start row.
+			unsigned long long pv = ~0ULL, mv = 0, last = 1ULL << (m - 1);
+			size_t score = m;
+			for (size_t i = 0; i < s.size(); i++) {
+				unsigned long long eq = _Peq[(unsigned char)s[i]];
+				unsigned long long xv = eq | mv;
+				unsigned long long xh = (((eq & pv) + pv) ^ pv) | eq;
+				unsigned long long ph = mv | ~(xh | pv);
+				unsigned long long mh = pv & xh;
+				if (ph & last) score++;
+				else if (mh & last) score--;
+				ph <<= 1;
+				mh <<= 1;
+				pv = mh | ~(xv | ph);
+				mv = ph & xv;
+
+				if (score < best) {
+					best = score;
+					if (best <= k) break;
+				}
+			}
+			return best;
+		}
+
+		std::vector<size_t> col(m + 1);
+		for (size_t j = 0; j <= m; j++) col[j] = j;
+		for (size_t i = 0; i < s.size(); i++) {
+			char c = _IgnoreCase ? _Ctx->to_lower(s[i]) : s[i];
+			size_t diag = 0;
+			for (size_t j = 1; j <= m; j++) {
+				char p = _IgnoreCase ? _Ctx->to_lower(_Needle[j - 1]) : _Needle[j - 1];
+				size_t cell = std::min(diag + (p == c ? 0 : 1), std::min(col[j], col[j - 1]) + 1);
+				diag = col[j];
+				col[j] = cell;
+			}
+			if (col[m] < best) {
+				best = col[m];
+				if (best <= k) break;
+			}
+		}
+		return best;
+	}
+
+	bool ApproxMatcher::contains(string_view s, size_t k) const
+	{
+		return scan(s, k) <= k;
+	}
+
+	size_t ApproxMatcher::distance(string_view s) const
+	{
+		return scan(s, 0);
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	CsvReader::CsvReader(char sep /*= ','*/, char quote /*= '"'*/) : _Sep(sep), _Quote(quote)
+	{
+		reset();
+	}
+
+	void CsvReader::reset()
+	{
+		_Buf.clear();
+		_Scratch.clear();
+		_FieldEnds.clear();
+		_RecStart = 0;
+		_ScanPos = 0;
+		_InQuote = false;
+		_Finished = false;
+	}
+
+	void CsvReader::feed(const char* data, size_t len)
+	{
+		// Drop consumed records before growing, field ends are relative to the record start.
+		if (_RecStart > 0 && _RecStart >= _Buf.size() / 2) {
+			_Buf.erase(0, _RecStart);
+			_ScanPos -= _RecStart;
+			_RecStart = 0;
+		}
+		_Buf.append(data, len);
+	}
+
+	void CsvReader::finish()
+	{
+		_Finished = true;
+	}
+
+	bool CsvReader::scan(size_t& recEnd)
+	{
+		const char* buf = _Buf.data();
+		size_t size = _Buf.size();
+
+		while (size - _ScanPos >= 64) {
+			const char* p = buf + _ScanPos;
+			unsigned long long inside = PrefixXor64(ByteMask64(p, _Quote));
+			if (_InQuote) inside = ~inside;
+
+			unsigned long long sep = ByteMask64(p, _Sep) & ~inside;
+			unsigned long long eol = ByteMask64(p, '\n') & ~inside;
+			unsigned long long marks = sep | eol;
+			while (marks != 0) {
+				unsigned int i = BitScan64(marks);
+				if (eol & (1ULL << i)) {
+					recEnd = _ScanPos + i;
+					_ScanPos = recEnd + 1;
+					_InQuote = false;
+					return true;
+				}
+				_FieldEnds.push_back(_ScanPos + i - _RecStart);
+				marks &= marks - 1;
+			}
+
+			_InQuote = (inside >> 63) != 0;
+			_ScanPos += 64;
+		}
+
+		for (; _ScanPos < size; _ScanPos++) {
+			char c = buf[_ScanPos];
+			if (c == _Quote) {
+				_InQuote = !_InQuote;
+			}
+			else if (!_InQuote) {
+				if (c == '\n') {
+					recEnd = _ScanPos++;
+					return true;
+				}
+				if (c == _Sep) _FieldEnds.push_back(_ScanPos - _RecStart);
+			}
+		}
+
+		if (_Finished && _RecStart < size) {
+			recEnd = size;
+			return true;
+		}
+		return false;
+	}
+
+	bool CsvReader::next(std::vector<string_view>& fields)
+	{
+		fields.clear();
+
+		size_t recEnd;
+		if (!scan(recEnd)) return false;
+
+		const char* rec = _Buf.data() + _RecStart;
+		size_t recLen = recEnd - _RecStart;
+		if (recLen > 0 && rec[recLen - 1] == '\r') recLen--;
+		_FieldEnds.push_back(recLen);
+
+		// Quoted fields with doubled quotes are unescaped into the scratch buffer, which is
+		// sized up front so views into it stay valid.
+		_Scratch.clear();
+		_Scratch.reserve(recLen);
+		std::vector<size_t> scratchAt(_FieldEnds.size(), (size_t)-1);
+		size_t start = 0;
+		for (size_t i = 0; i < _FieldEnds.size(); i++) {
+			const char* f = rec + start;
+			size_t len = _FieldEnds[i] - start;
+			if (len >= 2 && f[0] == _Quote && f[len - 1] == _Quote && memchr(f + 1, _Quote, len - 2) == NULL) {
+				fields.push_back(string_view(f + 1, len - 2));
+			}
+			else if (len > 0 && f[0] == _Quote) {
+				scratchAt[i] = _Scratch.size();
+				size_t j = 1;
+				for (; j < len; j++) {
+					if (f[j] != _Quote) {
+						_Scratch += f[j];
+					}
+					else if (j + 1 < len && f[j + 1] == _Quote) {
+						_Scratch += _Quote;
+						j++;
+					}
+					else {
+						break;
+					}
+				}
+				if (j + 1 < len) _Scratch.append(f + j + 1, len - j - 1);
+				fields.push_back(string_view(NULL, _Scratch.size() - scratchAt[i]));
+			}
+			else {
+				fields.push_back(string_view(f, len));
+			}
+			start = _FieldEnds[i] + 1;
+		}
+
+		for (size_t i = 0; i < fields.size(); i++) {
+			if (scratchAt[i] != (size_t)-1)
+				fields[i] = string_view(_Scratch.data() + scratchAt[i], fields[i].size());
+		}
+
+		_FieldEnds.clear();
+		_RecStart = recEnd < _Buf.size() ? recEnd + 1 : recEnd;
+		if (_ScanPos < _RecStart) _ScanPos = _RecStart;
+		return true;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	FieldIndex::FieldIndex() : _Data(NULL)
+	{
+	}
+
+	FieldIndex::FieldIndex(const char* data, size_t len, char sep, char eol /*= '\n'*/) : _Data(NULL)
+	{
+		build(data, len, sep, eol);
+	}
+
+	void FieldIndex::build(const char* data, size_t len, char sep, char eol /*= '\n'*/)
+	{
+		_Data = data;
+		_Eol = eol;
+		_Ends.clear();
+		_RowFirst.clear();
+		_RowFirst.push_back(0);
+
+		size_t i = 0;
+		for (; len - i >= 64; i += 64) {
+			unsigned long long eols = ByteMask64(data + i, eol);
+			unsigned long long marks = ByteMask64(data + i, sep) | eols;
+			while (marks != 0) {
+				unsigned int bit = BitScan64(marks);
+				_Ends.push_back(i + bit);
+				if (eols & (1ULL << bit)) _RowFirst.push_back(_Ends.size());
+				marks &= marks - 1;
+			}
+		}
+
+		for (; i < len; i++) {
+			if (data[i] == eol) {
+				_Ends.push_back(i);
+				_RowFirst.push_back(_Ends.size());
+			}
+			else if (data[i] == sep) {
+				_Ends.push_back(i);
+			}
+		}
+
+		// A last row without a line end still counts.
+		if (len == 0 || data[len - 1] != eol) {
+			_Ends.push_back(len);
+			_RowFirst.push_back(_Ends.size());
+		}
+	}
+
+	size_t FieldIndex::row_count() const
+	{
+		return _RowFirst.empty() ? 0 : _RowFirst.size() - 1;
+	}
+
+	size_t FieldIndex::field_count(size_t row) const
+	{
+		return row < row_count() ? _RowFirst[row + 1] - _RowFirst[row] : 0;
+	}
+
+	string_view FieldIndex::field(size_t row, size_t col, bool trimStr /*= false*/) const
+	{
+		if (col >= field_count(row)) return string_view();
+
+		size_t idx = _RowFirst[row] + col;
+		size_t begin = idx == 0 ? 0 : _Ends[idx - 1] + 1;
+		size_t end = _Ends[idx];
+		if (idx + 1 == _RowFirst[row + 1] && _Eol == '\n' && end > begin && _Data[end - 1] == '\r') end--;
+
+		string_view f(_Data + begin, end - begin);
+		return trimStr ? ViewSplitter::trim(f) : f;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	struct AsyncLineSource::State {
+		State(FILE* f, bool owned, size_t bufferSize, size_t bufferCount)
+			: file(f), ownsFile(owned), bufferSize(bufferSize), buffers(bufferCount), lengths(bufferCount, 0), ready(bufferCount, false),
+			done(false), failed(false), stop(false), slot(0), holding(false), pos(0) {}
+
+		// Reader thread: fill the ring in order, cutting each buffer after its last line end.
+		void read_loop() {
+			std::vector<char> carry;
+			size_t slotIdx = 0;
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					cv.wait(guard, [&]() { return stop || !ready[slotIdx]; });
+					if (stop) return;
+				}
+
+				std::vector<char>& buf = buffers[slotIdx];
+				size_t total = carry.size(), cut = 0;
+				if (buf.size() < total + bufferSize) buf.resize(total + bufferSize);
+				if (total > 0) memcpy(&buf[0], &carry[0], total);
+
+				bool last = false;
+				for (;;) {
+					size_t got = fread(&buf[total], 1, bufferSize, file);
+					size_t from = total;
+					total += got;
+					if (got < bufferSize) {
+						last = true;
+						break;
+					}
+
+					for (cut = total; cut > from && buf[cut - 1] != '\n'; cut--) {}
+					if (cut > from) break;
+
+					// The line is longer than the buffer, keep it whole.
+					buf.resize(total + bufferSize);
+				}
+
+				size_t len = last ? total : cut;
+				carry.assign(buf.begin() + len, buf.begin() + total);
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					lengths[slotIdx] = len;
+					ready[slotIdx] = len > 0;
+					failed = last && ferror(file) != 0;
+					done = last;
+				}
+				cv.notify_all();
+				if (last) return;
+				slotIdx = (slotIdx + 1) % buffers.size();
+			}
+		}
+
+		FILE* file;
+		bool ownsFile;
+		size_t bufferSize;
+		std::vector<std::vector<char> > buffers;
+		std::vector<size_t> lengths;
+		std::vector<bool> ready;	// filled and not yet released by the consumer
+		bool done;
+		bool failed;
+		bool stop;
+		std::mutex lock;
+		std::condition_variable cv;
+		std::thread reader;
+
+		size_t slot;				// consumer's current buffer
+		bool holding;
+		size_t pos;					// consumer's line position in the held buffer
+	};
+
+	AsyncLineSource::AsyncLineSource(size_t bufferSize /*= 1 << 20*/, size_t bufferCount /*= 4*/)
+		: _State(NULL), _BufferSize(bufferSize > 0 ? bufferSize : 1), _BufferCount(std::max(bufferCount, (size_t)2))
+	{
+	}
+
+	AsyncLineSource::~AsyncLineSource()
+	{
+		close();
+	}
+
+	bool AsyncLineSource::open(const std::string& path)
+	{
+		FILE* file = NULL;
+#if defined(_MSC_VER)
+		if (fopen_s(&file, path.c_str(), "rb") != 0) file = NULL;
+#else
+		file = fopen(path.c_str(), "rb");
+#endif
+		return start(file, true);
+	}
+
+	bool AsyncLineSource::attach(FILE* file)
+	{
+		return start(file, false);
+	}
+
+	bool AsyncLineSource::start(FILE* file, bool owned)
+	{
+		close();
+		if (file == NULL) return false;
+
+		_State = new State(file, owned, _BufferSize, _BufferCount);
+		_State->reader = std::thread(&State::read_loop, _State);
+		return true;
+	}
+
+	void AsyncLineSource::close()
+	{
+		if (_State == NULL) return;
+
+		{
+			std::lock_guard<std::mutex> guard(_State->lock);
+			_State->stop = true;
+		}
+		_State->cv.notify_all();
+		_State->reader.join();
+		if (_State->ownsFile) fclose(_State->file);
+
+		delete _State;
+		_State = NULL;
+	}
+
+	bool AsyncLineSource::next_chunk(string_view& chunk)
+	{
+		if (_State == NULL) return false;
+
+		State& st = *_State;
+		std::unique_lock<std::mutex> guard(st.lock);
+		if (st.holding) {
+			st.ready[st.slot] = false;
+			st.slot = (st.slot + 1) % st.buffers.size();
+			st.holding = false;
+			st.cv.notify_all();
+		}
+
+		st.cv.wait(guard, [&]() { return st.ready[st.slot] || st.done; });
+		if (!st.ready[st.slot]) return false;
+
+		st.holding = true;
+		st.pos = 0;
+		chunk = string_view(&st.buffers[st.slot][0], st.lengths[st.slot]);
+		return true;
+	}
+
+	bool AsyncLineSource::next_line(string_view& line)
+	{
+		if (_State == NULL) return false;
+
+		State& st = *_State;
+		if (!st.holding || st.pos >= st.lengths[st.slot]) {
+			string_view chunk;
+			if (!next_chunk(chunk)) return false;
+		}
+
+		const char* begin = &st.buffers[st.slot][0] + st.pos;
+		size_t rest = st.lengths[st.slot] - st.pos;
+		const char* eol = (const char*)memchr(begin, '\n', rest);
+		size_t len = eol != NULL ? (size_t)(eol - begin) : rest;
+		st.pos += eol != NULL ? len + 1 : len;
+
+		if (eol != NULL && len > 0 && begin[len - 1] == '\r') len--;
+		line = string_view(begin, len);
+		return true;
+	}
+
+	bool AsyncLineSource::next_fields(const std::string& sep, std::vector<string_view>& fields, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	{
+		fields.clear();
+
+		string_view line;
+		if (!next_line(line)) return false;
+
+		ViewSplitter splitter(line.data(), line.size(), sep);
+		string_view field;
+		while (splitter.next(field)) {
+			if (excludeEmpty && field.empty()) continue;
+			fields.push_back(trimStr ? ViewSplitter::trim(field) : field);
+		}
+		return true;
+	}
+
+	bool AsyncLineSource::error() const
+	{
+		if (_State == NULL) return false;
+
+		std::lock_guard<std::mutex> guard(_State->lock);
+		return _State->failed;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Bounded multi-producer multi-consumer queue (Vyukov): one CAS per operation, no locks.
+	template<typename T>
+	class MpmcQueue {
+	public:
+		explicit MpmcQueue(size_t capacity) : _EnqueuePos(0), _DequeuePos(0) {
+			size_t n = 2;
+			while (n < capacity) n <<= 1;
+			_Cells = new Cell[n];
+			_Mask = n - 1;
+			for (size_t i = 0; i < n; i++)
+				_Cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+
+		~MpmcQueue() { delete[] _Cells; }
+
+		bool try_push(const T& value) {
+			Cell* cell;
+			size_t pos = _EnqueuePos.load(std::memory_order_relaxed);
+			for (;;) {
+				cell = &_Cells[pos & _Mask];
+				ptrdiff_t dif = (ptrdiff_t)cell->seq.load(std::memory_order_acquire) - (ptrdiff_t)pos;
+				if (dif == 0) {
+					if (_EnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+				}
+				else if (dif < 0) {
+					return false;
+				}
+				else {
+					pos = _EnqueuePos.load(std::memory_order_relaxed);
+				}
+			}
+			cell->data = value;
+			cell->seq.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool try_pop(T& value) {
+			Cell* cell;
+			size_t pos = _DequeuePos.load(std::memory_order_relaxed);
+			for (;;) {
+				cell = &_Cells[pos & _Mask];
+				ptrdiff_t dif = (ptrdiff_t)cell->seq.load(std::memory_order_acquire) - (ptrdiff_t)(pos + 1);
+				if (dif == 0) {
+					if (_DequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+				}
+				else if (dif < 0) {
+					return false;
+				}
+				else {
+					pos = _DequeuePos.load(std::memory_order_relaxed);
+				}
+			}
+			value = cell->data;
+			cell->seq.store(pos + _Mask + 1, std::memory_order_release);
+			return true;
+		}
+
+	private:
+		MpmcQueue(const MpmcQueue&);
+		MpmcQueue& operator=(const MpmcQueue&);
+
+		struct Cell {
+			std::atomic<size_t> seq;
+			T data;
+		};
+
+		Cell* _Cells;
+		size_t _Mask;
+		char _Pad0[64];
+		std::atomic<size_t> _EnqueuePos;
+		char _Pad1[64];
+		std::atomic<size_t> _DequeuePos;
+	};
+
+	// Parks threads waiting for a queue to change. Notifiers only take the mutex while someone
+	// sleeps, so the busy path stays lock-free.
+	class Parker {
+	public:
+		Parker() : _Sleepers(0) {}
+
+		// Returns once ready() is true, spinning briefly before sleeping.
+		template<typename TReady>
+		void wait(TReady ready) {
+			for (int i = 0; i < 64; i++) {
+				if (ready()) return;
+				std::this_thread::yield();
+			}
+
+			std::unique_lock<std::mutex> guard(_Lock);
+			_Sleepers.fetch_add(1);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			while (!ready()) _Wake.wait(guard);
+			_Sleepers.fetch_sub(1);
+		}
+
+		// Call after changing what ready() reads.
+		void notify() {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (_Sleepers.load(std::memory_order_relaxed) == 0) return;
+
+			std::lock_guard<std::mutex> guard(_Lock);
+			_Wake.notify_all();
+		}
+
+	private:
+		std::mutex _Lock;
+		std::condition_variable _Wake;
+		std::atomic<int> _Sleepers;
+	};
+
+	struct Pipeline::State {
+		struct Batch {
+			unsigned long long seq;
+			std::vector<std::string> items;
+		};
+
+		typedef std::function<void(std::vector<std::string>&)> Stage;
+
+		// At most window batches are between push() and next_batch(): the queues plus one per worker.
+		State(size_t workerCount, bool ordered, size_t batchSize)
+			: workerCount(workerCount), ordered(ordered), batchSize(batchSize), window(workerCount * 5),
+			input(workerCount * 2), output(workerCount * 2), pending(workerCount * 5, (Batch*)NULL),
+			current(NULL), produced(0), consumed(0), closed(false), abort(false) {}
+
+		~State() {
+			abort = true;
+			workersWake.notify();
+			for (size_t i = 0; i < workers.size(); i++)
+				workers[i].join();
+
+			Batch* b;
+			while (input.try_pop(b)) delete b;
+			while (output.try_pop(b)) delete b;
+			for (size_t i = 0; i < pending.size(); i++)
+				delete pending[i];
+			delete current;
+		}
+
+		void work() {
+			for (;;) {
+				Batch* b = NULL;
+				workersWake.wait([this, &b]() {
+					if (input.try_pop(b)) return true;
+					// The end flag is set after the last push, so read it before the final check.
+					bool end = closed.load(std::memory_order_acquire);
+					return input.try_pop(b) || end || abort;
+				});
+				if (b == NULL) return;
+				producerWake.notify();
+
+				for (size_t i = 0; i < stages.size(); i++)
+					stages[i](b->items);
+
+				bool pushed = false;
+				workersWake.wait([this, b, &pushed]() { return (pushed = output.try_push(b)) || abort; });
+				if (!pushed) {
+					delete b;
+					return;
+				}
+				consumerWake.notify();
+			}
+		}
+
+		void submit() {
+			if (workers.empty()) {
+				for (size_t i = 0; i < workerCount; i++)
+					workers.push_back(std::thread(&State::work, this));
+			}
+
+			unsigned long long seq = produced.load(std::memory_order_relaxed);
+			current->seq = seq;
+			bool pushed = false;
+			producerWake.wait([this, seq, &pushed]() {
+				if (abort) return true;
+				if (seq - consumed.load(std::memory_order_acquire) >= window) return false;
+				return pushed = input.try_push(current);
+			});
+			if (!pushed) return;
+
+			current = NULL;
+			produced.store(seq + 1, std::memory_order_release);
+			workersWake.notify();
+		}
+
+		size_t workerCount;
+		bool ordered;
+		size_t batchSize;
+		size_t window;
+		std::vector<Stage> stages;
+		MpmcQueue<Batch*> input;
+		MpmcQueue<Batch*> output;
+		std::vector<Batch*> pending;				// completed out of order, by seq % window
+		std::vector<std::thread> workers;
+		Parker producerWake;						// room in the input queue and the window
+		Parker workersWake;							// input to take, or room in the output queue
+		Parker consumerWake;						// output to deliver
+
+		Batch* current;								// producer's batch being filled
+		std::atomic<unsigned long long> produced;	// batches submitted
+		std::atomic<unsigned long long> consumed;	// batches delivered or dropped empty
+		std::atomic<bool> closed;
+		std::atomic<bool> abort;
+	};
+
+	Pipeline::Pipeline(size_t threads /*= 0*/, bool ordered /*= true*/, size_t batchSize /*= 1024*/)
+		: _State(new State(ParallelHelper::worker_count((size_t)-1, threads, 1), ordered, batchSize > 0 ? batchSize : 1))
+	{
+	}
+
+	Pipeline::~Pipeline()
+	{
+		delete _State;
+	}
+
+	Pipeline& Pipeline::split(const std::string& sep, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	{
+		_State->stages.push_back([sep, excludeEmpty, trimStr](std::vector<std::string>& items) {
+			std::vector<std::string> fields;
+			for (size_t i = 0; i < items.size(); i++) {
+				ViewSplitter splitter(items[i].data(), items[i].size(), sep);
+				string_view field;
+				while (splitter.next(field)) {
+					if (excludeEmpty && field.empty()) continue;
+					if (trimStr) field = ViewSplitter::trim(field);
+					fields.push_back(field.str());
+				}
+			}
+			items.swap(fields);
+		});
+		return *this;
+	}
+
+	Pipeline& Pipeline::trim()
+	{
+		return map([](std::string& s) { cx::trim(s); });
+	}
+
+	Pipeline& Pipeline::normalize_space()
+	{
+		return map([](std::string& s) { cx::normalize_space(s); });
+	}
+
+	Pipeline& Pipeline::to_lower(const CaseContext& ctx)
 	{
-		if (src.length() != dst.length()) return false;
-
-		return StringCompareHelper::equals(src, dst, ignoreCase);
+		const CaseContext* c = &ctx;
+		return map([c](std::string& s) { StringCaseHelper::to_lower(s, *c); });
 	}
 
-	bool equals(const std::wstring& src, const std::wstring& dst, bool ignoreCase /*= false*/)
+	Pipeline& Pipeline::to_upper(const CaseContext& ctx)
 	{
-		if (src.length() != dst.length()) return false;
-
-		return StringCompareHelper::equals(src, dst, ignoreCase);
+		const CaseContext* c = &ctx;
+		return map([c](std::string& s) { StringCaseHelper::to_upper(s, *c); });
 	}
 
-	bool starts_with(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/)
+	Pipeline& Pipeline::filter_contains(const std::string& needle, bool ignoreCase /*= false*/, const CaseContext& ctx)
 	{
-		return StringCompareHelper::starts_with(src, dst, ignoreCase);
+		const CaseContext* c = &ctx;
+		return filter([needle, ignoreCase, c](const std::string& s) { return StringCompareHelper::contains(s, needle, ignoreCase, *c); });
 	}
 
-	bool starts_with(const std::wstring& src, const std::wstring& dst, bool ignoreCase /*= false*/)
+	Pipeline& Pipeline::map(const std::function<void(std::string&)>& fn)
 	{
-		return StringCompareHelper::starts_with(src, dst, ignoreCase);
+		_State->stages.push_back([fn](std::vector<std::string>& items) {
+			for (size_t i = 0; i < items.size(); i++)
+				fn(items[i]);
+		});
+		return *this;
 	}
 
-	bool ends_with(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/)
+	Pipeline& Pipeline::filter(const std::function<bool(const std::string&)>& fn)
 	{
-		return StringCompareHelper::ends_with(src, dst, ignoreCase);
+		_State->stages.push_back([fn](std::vector<std::string>& items) {
+			size_t kept = 0;
+			for (size_t i = 0; i < items.size(); i++) {
+				if (!fn(items[i])) continue;
+				if (kept != i) items[kept].swap(items[i]);
+				kept++;
+			}
+			items.resize(kept);
+		});
+		return *this;
 	}
 
-	bool ends_with(const std::wstring& src, const std::wstring& dst, bool ignoreCase /*= false*/)
+	void Pipeline::push(string_view line)
 	{
-		return StringCompareHelper::ends_with(src, dst, ignoreCase);
+		State& st = *_State;
+		if (st.closed.load(std::memory_order_relaxed)) return;
+
+		if (st.current == NULL) {
+			st.current = new State::Batch();
+			st.current->items.reserve(st.batchSize);
+		}
+		st.current->items.push_back(line.str());
+		if (st.current->items.size() >= st.batchSize) st.submit();
 	}
 
-	bool contains(const std::string& src, const std::string& dst, bool ignoreCase /*= false*/)
+	void Pipeline::close()
 	{
-		return StringCompareHelper::contains(src, dst, ignoreCase);
+		State& st = *_State;
+		if (st.closed.load(std::memory_order_relaxed)) return;
+
+		if (st.current != NULL) st.submit();
+		st.closed.store(true, std::memory_order_release);
+		st.workersWake.notify();
+		st.consumerWake.notify();
 	}
 
-	bool contains(const std::wstring& src, const std::wstring& dst, bool ignoreCase /*= false*/)
+	bool Pipeline::next_batch(std::vector<std::string>& results)
 	{
-		return StringCompareHelper::contains(src, dst, ignoreCase);
-	}
+		State& st = *_State;
+		for (;;) {
+			unsigned long long next = st.consumed.load(std::memory_order_relaxed);
+			State::Batch*& parked = st.pending[next % st.window];
+			State::Batch* b = NULL;
+			if (st.ordered && parked != NULL) {
+				b = parked;
+				parked = NULL;
+			}
+			else {
+				st.consumerWake.wait([&st, &b, next]() {
+					if (st.output.try_pop(b)) return true;
+					return st.closed.load(std::memory_order_acquire) && next == st.produced.load(std::memory_order_acquire);
+				});
+				if (b == NULL) return false;
+				st.workersWake.notify();
 
-	void to_lower(std::string& src) {
-		StringCaseHelper::to_lower(src);
-	}
+				// seq - next < window, so out-of-order batches never share a slot.
+				if (st.ordered && b->seq != next) {
+					st.pending[b->seq % st.window] = b;
+					continue;
+				}
+			}
 
-	void to_lower(std::wstring& src) {
-		StringCaseHelper::to_lower(src);
+			st.consumed.store(next + 1, std::memory_order_release);
+			st.producerWake.notify();
+			bool empty = b->items.empty();
+			results.swap(b->items);
+			delete b;
+			if (!empty) return true;
+		}
 	}
 
-	void to_lower(const std::string& src, std::string& dst) {
-		StringCaseHelper::to_lower_copy(src, dst);
-	}
+	void Pipeline::run(const std::vector<std::string>& lines, std::vector<std::string>& results)
+	{
+		results.clear();
 
-	void to_lower(const std::wstring& src, std::wstring& dst) {
-		StringCaseHelper::to_lower_copy(src, dst);
-	}
+		std::thread producer([this, &lines]() {
+			for (size_t i = 0; i < lines.size(); i++)
+				push(lines[i]);
+			close();
+		});
 
-	std::string  to_lower_copy(const std::string& src) {
-		return StringCaseHelper::to_lower_copy(src);
+		std::vector<std::string> batch;
+		while (next_batch(batch)) {
+			for (size_t i = 0; i < batch.size(); i++) {
+				results.push_back(std::string());
+				results.back().swap(batch[i]);
+			}
+		}
+		producer.join();
 	}
 
-	std::wstring to_lower_copy(const std::wstring& src) {
-		return StringCaseHelper::to_lower_copy(src);
+	//////////////////////////////////////////////////////////////////////////
+	// Integer and floating-point text writers behind append_int() and friends, and the format() fast path.
+	class NumberFormatHelper {
+	public:
+		struct DiyFp {
+			DiyFp() : f(0), e(0) {}
+			DiyFp(unsigned long long f, int e) : f(f), e(e) {}
+
+			explicit DiyFp(double d) {
+				unsigned long long bits;
+				memcpy(&bits, &d, sizeof(bits));
+				int biased = (int)((bits >> 52) & 0x7FF);
+				f = bits & FracMask;
+				if (biased != 0) {
+					f += HiddenBit;
+					e = biased - 1075;
+				}
+				else {
+					e = -1074;
+				}
+			}
+
+			// Upper 64 bits of the 128-bit product, rounded.
+			DiyFp operator*(const DiyFp& rhs) const {
+				unsigned long long hi, lo;
+				mul64(f, rhs.f, hi, lo);
+				return DiyFp(hi + (lo >> 63), e + rhs.e + 64);
+			}
+
+			DiyFp normalize() const {
+				DiyFp r = *this;
+				while (!(r.f & (1ULL << 63))) {
+					r.f <<= 1;
+					r.e--;
+				}
+				return r;
+			}
+
+			// The neighbours halfway to the adjacent doubles, sharing the exponent of the upper one.
+			void boundaries(DiyFp& minus, DiyFp& plus) const {
+				plus = DiyFp((f << 1) + 1, e - 1).normalize();
+				minus = f == HiddenBit ? DiyFp((f << 2) - 1, e - 2) : DiyFp((f << 1) - 1, e - 1);
+				minus.f <<= minus.e - plus.e;
+				minus.e = plus.e;
+			}
+
+			unsigned long long f;
+			int e;
+		};
+
+		static const unsigned long long FracMask = 0x000FFFFFFFFFFFFFULL;
+		static const unsigned long long HiddenBit = 0x0010000000000000ULL;
+
+		static void mul64(unsigned long long a, unsigned long long b, unsigned long long& hi, unsigned long long& lo) {
+			unsigned long long a1 = a >> 32, a0 = a & 0xFFFFFFFF, b1 = b >> 32, b0 = b & 0xFFFFFFFF;
+			unsigned long long p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+			unsigned long long mid = (p00 >> 32) + (p01 & 0xFFFFFFFF) + (p10 & 0xFFFFFFFF);
+			hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+			lo = (mid << 32) | (p00 & 0xFFFFFFFF);
+		}
+
+		static const unsigned long long* pow10() {
+			static const unsigned long long table[20] = {
+				1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+				1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+				100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+				1000000000000000000ULL, 10000000000000000000ULL
+			};
+			return table;
+		}
+
+		// Writes the digits of v backwards, ending just before end; returns the first digit.
+		static char* write_uint_back(char* end, unsigned long long v) {
+			static const char pairs[] =
+				"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+				"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+				"8081828384858687888990919293949596979899";
+			while (v >= 100) {
+				unsigned int i = (unsigned int)(v % 100) * 2;
+				v /= 100;
+				*--end = pairs[i + 1];
+				*--end = pairs[i];
+			}
+			if (v >= 10) {
+				*--end = pairs[v * 2 + 1];
+				*--end = pairs[v * 2];
+			}
+			else {
+				*--end = (char)('0' + v);
+			}
+			return end;
+		}
+
+		static char* write_uint(char* p, unsigned long long v) {
+			char tmp[20];
+			char* first = write_uint_back(tmp + sizeof(tmp), v);
+			size_t n = tmp + sizeof(tmp) - first;
+			memcpy(p, first, n);
+			return p + n;
+		}
+
+		static char* write_int(char* p, long long v) {
+			if (v < 0) {
+				*p++ = '-';
+				return write_uint(p, 0 - (unsigned long long)v);
+			}
+			return write_uint(p, (unsigned long long)v);
+		}
+
+		static char* write_hex(char* p, unsigned long long v, bool upperCase) {
+			const char* digits = upperCase ? "0123456789ABCDEF" : "0123456789abcdef";
+			int shift = 60;
+			while (shift > 0 && (v >> shift) == 0) shift -= 4;
+			for (; shift >= 0; shift -= 4)
+				*p++ = digits[(v >> shift) & 0xF];
+			return p;
+		}
+
+		// Normalized 10^k for k = -348, -340, ..., 340, rounded from exact big-integer arithmetic on first use.
+		static const DiyFp& cached_power(int index) {
+			static const std::vector<DiyFp> table = make_cached_powers();
+			return table[index];
+		}
+
+		static std::vector<DiyFp> make_cached_powers() {
+			std::vector<DiyFp> table;
+			for (int k = -348; k <= 340; k += 8) {
+				std::vector<unsigned int> big;
+				int shift = 0;
+				if (k >= 0) {
+					big.push_back(1);
+					for (int i = 0; i < k; i++) mul_small(big, 10);
+				}
+				else {
+					// floor(2^shift / 10^-k), with shift large enough to leave more than 64 significant bits.
+					shift = -k * 10 / 3 + 72;
+					big.assign(shift / 32 + 1, 0);
+					big.back() = 1U << (shift % 32);
+					for (int i = 0; i < -k; i++) div_small(big, 10);
+				}
+				table.push_back(top_bits(big, shift));
+			}
+			return table;
+		}
+
+		static void mul_small(std::vector<unsigned int>& big, unsigned int m) {
+			unsigned long long carry = 0;
+			for (size_t i = 0; i < big.size(); i++) {
+				carry += (unsigned long long)big[i] * m;
+				big[i] = (unsigned int)carry;
+				carry >>= 32;
+			}
+			if (carry) big.push_back((unsigned int)carry);
+		}
+
+		static void div_small(std::vector<unsigned int>& big, unsigned int d) {
+			unsigned long long rem = 0;
+			for (size_t i = big.size(); i-- > 0; ) {
+				rem = (rem << 32) | big[i];
+				big[i] = (unsigned int)(rem / d);
+				rem %= d;
+			}
+			while (big.size() > 1 && big.back() == 0) big.pop_back();
+		}
+
+		// The 64 leading bits of big / 2^shift, rounded to nearest.
+		static DiyFp top_bits(const std::vector<unsigned int>& big, int shift) {
+			int len = (int)(big.size() - 1) * 32;
+			for (unsigned int top = big.back(); top; top >>= 1) len++;
+
+			unsigned long long f = 0;
+			for (int i = 0; i < 64; i++) f = (f << 1) | bit(big, len - 1 - i);
+			int e = len - 64 - shift;
+			if (bit(big, len - 65)) {
+				if (++f == 0) {
+					f = 1ULL << 63;
+					e++;
+				}
+			}
+			return DiyFp(f, e);
+		}
+
+		static unsigned long long bit(const std::vector<unsigned int>& big, int i) {
+			return i < 0 ? 0 : (big[i / 32] >> (i % 32)) & 1;
+		}
+
+		// Shortest digits that read back as v (Grisu2), with v = digits * 10^k; v must be finite and positive.
+		static int grisu2(double v, char* digits, int& k) {
+			DiyFp w = DiyFp(v), minus, plus;
+			w.boundaries(minus, plus);
+
+			// Pick 10^-k that brings the upper boundary's exponent into [-60, -32].
+			double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+			int ik = (int)dk;
+			if (dk - ik > 0.0) ik++;
+			int index = (ik >> 3) + 1;
+			k = -(-348 + index * 8);
+			const DiyFp& c = cached_power(index);
+
+			DiyFp W = w.normalize() * c, Wp = plus * c, Wm = minus * c;
+			Wm.f++;
+			Wp.f--;
+
+			int len = 0;
+			digit_gen(W, Wp, Wp.f - Wm.f, digits, len, k);
+			return len;
+		}
+
+		static void digit_gen(const DiyFp& W, const DiyFp& Mp, unsigned long long delta, char* digits, int& len, int& k) {
+			const unsigned long long* p10 = pow10();
+			DiyFp one(1ULL << -Mp.e, Mp.e);
+			unsigned long long wpw = Mp.f - W.f;
+			unsigned int p1 = (unsigned int)(Mp.f >> -one.e);
+			unsigned long long p2 = Mp.f & (one.f - 1);
+
+			int kappa = 1;
+			while (kappa < 10 && p1 >= p10[kappa]) kappa++;
+
+			while (kappa > 0) {
+				unsigned int d = (unsigned int)(p1 / p10[kappa - 1]);
+				p1 %= (unsigned int)p10[kappa - 1];
+				if (d || len) digits[len++] = (char)('0' + d);
+				kappa--;
+				unsigned long long rest = ((unsigned long long)p1 << -one.e) + p2;
+				if (rest <= delta) {
+					k += kappa;
+					grisu_round(digits, len, delta, rest, p10[kappa] << -one.e, wpw);
+					return;
+				}
+			}
+
+			for (;;) {
+				p2 *= 10;
+				delta *= 10;
+				char d = (char)(p2 >> -one.e);
+				if (d || len) digits[len++] = (char)('0' + d);
+				p2 &= one.f - 1;
+				kappa--;
+				if (p2 < delta) {
+					k += kappa;
+					grisu_round(digits, len, delta, p2, one.f, -kappa < 20 ? wpw * p10[-kappa] : 0);
+					return;
+				}
+			}
+		}
+
+		// Walks the last digit down while that moves closer to the exact value and stays in range.
+		static void grisu_round(char* digits, int len, unsigned long long delta, unsigned long long rest, unsigned long long tenKappa, unsigned long long wpw) {
+			while (rest < wpw && delta - rest >= tenKappa &&
+				(rest + tenKappa < wpw || wpw - rest > rest + tenKappa - wpw)) {
+				digits[len - 1]--;
+				rest += tenKappa;
+			}
+		}
+
+		// Shortest round-trip text: fixed notation for exponents in [-4, 17), otherwise d.ddde+XX.
+		static char* write_double(char* p, double v) {
+			if (v != v) {
+				memcpy(p, "nan", 3);
+				return p + 3;
+			}
+
+			unsigned long long bits;
+			memcpy(&bits, &v, sizeof(bits));
+			if (bits >> 63) {
+				*p++ = '-';
+				v = -v;
+			}
+			if (v == 0) {
+				*p++ = '0';
+				return p;
+			}
+			if (v > std::numeric_limits<double>::max()) {
+				memcpy(p, "inf", 3);
+				return p + 3;
+			}
+
+			char digits[20];
+			int k;
+			int len = grisu2(v, digits, k);
+			int point = len + k;	// digits before the decimal point
+
+			if (point > -4 && point <= 17) {
+				if (point <= 0) {
+					*p++ = '0';
+					*p++ = '.';
+					for (int i = point; i < 0; i++) *p++ = '0';
+					memcpy(p, digits, len);
+					return p + len;
+				}
+				if (len <= point) {
+					memcpy(p, digits, len);
+					p += len;
+					for (int i = len; i < point; i++) *p++ = '0';
+					return p;
+				}
+				memcpy(p, digits, point);
+				p += point;
+				*p++ = '.';
+				memcpy(p, digits + point, len - point);
+				return p + len - point;
+			}
+
+			*p++ = digits[0];
+			if (len > 1) {
+				*p++ = '.';
+				memcpy(p, digits + 1, len - 1);
+				p += len - 1;
+			}
+			return write_exponent(p, point - 1);
+		}
+
+		static char* write_exponent(char* p, int exp) {
+			*p++ = 'e';
+			*p++ = exp < 0 ? '-' : '+';
+			unsigned int u = exp < 0 ? -exp : exp;
+			if (u < 10) *p++ = '0';
+			return write_uint(p, u);
+		}
+
+		// round(a * 10^prec), ties to even as printf rounds; false if that does not fit 64 bits.
+		static bool scale_round(double a, int prec, unsigned long long& n) {
+			DiyFp w(a);
+			if (w.f == 0) {
+				n = 0;
+				return true;
+			}
+
+			unsigned long long hi, lo;
+			mul64(w.f, pow10()[prec], hi, lo);
+			if (w.e >= 0) {
+				if (hi != 0 || w.e >= 64 || (w.e > 0 && (lo >> (64 - w.e)) != 0)) return false;
+				n = lo << w.e;
+				return true;
+			}
+
+			int s = -w.e;
+			if (s >= 118) {
+				// The product is below 2^117, so less than half of 2^s.
+				n = 0;
+				return true;
+			}
+
+			// q = (hi:lo) >> s, and the bits shifted out compared against one half.
+			unsigned long long q, restHi, restLo, halfHi, halfLo;
+			if (s > 64) {
+				q = hi >> (s - 64);
+				restHi = hi & ((1ULL << (s - 64)) - 1);
+				restLo = lo;
+				halfHi = 1ULL << (s - 65);
+				halfLo = 0;
+			}
+			else if (s == 64) {
+				q = hi;
+				restHi = 0;
+				restLo = lo;
+				halfHi = 0;
+				halfLo = 1ULL << 63;
+			}
+			else {
+				if ((hi >> s) != 0) return false;
+				q = (hi << (64 - s)) | (lo >> s);
+				restHi = 0;
+				restLo = lo & ((1ULL << s) - 1);
+				halfHi = 0;
+				halfLo = 1ULL << (s - 1);
+			}
+
+			bool above = restHi > halfHi || (restHi == halfHi && restLo > halfLo);
+			bool tie = restHi == halfHi && restLo == halfLo;
+			if (above || (tie && (q & 1))) {
+				if (++q == 0) return false;
+			}
+			n = q;
+			return true;
+		}
+
+		// printf's %.<prec>f for finite v, at most 41 characters; NULL when the value is out of the exact fast range.
+		static char* write_fixed(char* p, double v, int prec) {
+			if (prec > 19) return NULL;
+
+			bool negative = std::signbit(v);
+			unsigned long long n;
+			if (!scale_round(negative ? -v : v, prec, n)) return NULL;
+
+			if (negative) *p++ = '-';
+			p = write_uint(p, n / pow10()[prec]);
+			if (prec > 0) {
+				*p++ = '.';
+				char* frac = p + prec;
+				char* first = write_uint_back(frac, n % pow10()[prec]);
+				while (first > p) *--first = '0';
+				p = frac;
+			}
+			return p;
+		}
+
+		// printf's %.<prec>g for finite v when it takes the fixed style; NULL otherwise.
+		static char* write_general(char* p, double v, int prec) {
+			if (prec == 0) prec = 1;
+			if (prec > 17) return NULL;
+
+			bool negative = std::signbit(v);
+			double a = negative ? -v : v;
+			if (negative) *p++ = '-';
+			if (a == 0) {
+				*p++ = '0';
+				return p;
+			}
+
+			// X is the decimal exponent after rounding to prec significant digits.
+			int x = (int)floor(log10(a));
+			unsigned long long n = 0;
+			for (int tries = 0; ; tries++) {
+				if (tries == 3 || x < -4 || x >= prec) return NULL;
+				int fracDigits = prec - 1 - x;
+				if (fracDigits > 19 || !scale_round(a, fracDigits, n)) return NULL;
+				if (n >= pow10()[prec]) x++;
+				else if (n < pow10()[prec - 1]) x--;
+				else break;
+			}
+
+			int fracDigits = prec - 1 - x;
+			p = write_uint(p, n / pow10()[fracDigits]);
+			unsigned long long frac = n % pow10()[fracDigits];
+			if (frac != 0) {
+				while (frac % 10 == 0) {
+					frac /= 10;
+					fracDigits--;
+				}
+				*p++ = '.';
+				char* end = p + fracDigits;
+				char* first = write_uint_back(end, frac);
+				while (first > p) *--first = '0';
+				p = end;
+			}
+			return p;
+		}
+	};
+
+	char* append_int(char* buffer, long long value)
+	{
+		char* p = NumberFormatHelper::write_int(buffer, value);
+		*p = '\0';
+		return p;
 	}
 
-	void to_upper(std::string& src) {
-		StringCaseHelper::to_upper(src);
+	void append_int(std::string& dst, long long value)
+	{
+		char buf[24];
+		dst.append(buf, NumberFormatHelper::write_int(buf, value));
 	}
 
-	void to_upper(std::wstring& src) {
-		StringCaseHelper::to_upper(src);
+	char* append_uint(char* buffer, unsigned long long value)
+	{
+		char* p = NumberFormatHelper::write_uint(buffer, value);
+		*p = '\0';
+		return p;
 	}
 
-	void to_upper(const std::string& src, std::string& dst) {
-		StringCaseHelper::to_upper_copy(src, dst);
+	void append_uint(std::string& dst, unsigned long long value)
+	{
+		char buf[24];
+		dst.append(buf, NumberFormatHelper::write_uint(buf, value));
 	}
 
-	void to_upper(const std::wstring& src, std::wstring& dst) {
-		StringCaseHelper::to_upper_copy(src, dst);
+	char* append_hex(char* buffer, unsigned long long value, bool upperCase /*= false*/)
+	{
+		char* p = NumberFormatHelper::write_hex(buffer, value, upperCase);
+		*p = '\0';
+		return p;
 	}
 
-	std::string  to_upper_copy(const std::string& src) {
-		return StringCaseHelper::to_upper_copy(src);
+	void append_hex(std::string& dst, unsigned long long value, bool upperCase /*= false*/)
+	{
+		char buf[24];
+		dst.append(buf, NumberFormatHelper::write_hex(buf, value, upperCase));
 	}
 
-	std::wstring to_upper_copy(const std::wstring& src) {
-		return StringCaseHelper::to_upper_copy(src);
+	char* append_double(char* buffer, double value)
+	{
+		char* p = NumberFormatHelper::write_double(buffer, value);
+		*p = '\0';
+		return p;
 	}
 
-	// from stl_string.h
-	template <class _TStr, class _TIter>
-	static void split_str(const _TStr& s, _TIter iter, const _TStr& sep, bool exceptEmpty = false, bool trimStr = false)
+	void append_double(std::string& dst, double value)
 	{
-		_TStr dst;
+		char buf[32];
+		dst.append(buf, NumberFormatHelper::write_double(buf, value));
+	}
 
-		if (s.size() == 0)
-			return;
+	//////////////////////////////////////////////////////////////////////////
+	// Output targets of the escaping and format writers.
+	struct StringSink {
+		explicit StringSink(std::string& s) : _Str(&s) {}
+		void append(const char* p, size_t n) { _Str->append(p, n); }
+		std::string* _Str;
+	};
 
-		for (size_t i = 0; i < s.size(); i++)
-		{
-			size_t id = sep.find(s[i]);
-			if (id != _TStr::npos)
-			{
-				if (!exceptEmpty || dst.size() > 0)
-				{
-					if (trimStr) cx::trim(dst);
-					*iter = dst;
-					dst.resize(0);
+	struct BufferSink {
+		explicit BufferSink(char* p) : _End(p) {}
+		void append(const char* p, size_t n) { memcpy(_End, p, n); _End += n; }
+		char* _End;
+	};
+
+	// JSON and CSV escaping: clean runs are found 32 bytes at a time and copied whole.
+	class EscapeHelper {
+	public:
+		// Length of the prefix holding none of the four specials, nor control characters if controls is set.
+		static size_t clean_prefix(const char* p, size_t n, const char specials[4], bool controls) {
+			size_t i = 0;
+#if defined(CX_AVX2)
+			__m256i s0 = _mm256_set1_epi8(specials[0]), s1 = _mm256_set1_epi8(specials[1]);
+			__m256i s2 = _mm256_set1_epi8(specials[2]), s3 = _mm256_set1_epi8(specials[3]);
+			__m256i low = _mm256_set1_epi8(controls ? 0x1F : 0);
+			for (; i + 32 <= n; i += 32) {
+				__m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+				__m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, s0), _mm256_cmpeq_epi8(v, s1)),
+					_mm256_or_si256(_mm256_cmpeq_epi8(v, s2), _mm256_cmpeq_epi8(v, s3)));
+				if (controls) hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(_mm256_max_epu8(v, low), low));
+				unsigned int m = (unsigned int)_mm256_movemask_epi8(hit);
+				if (m) return i + BitScan64(m);
+			}
+#elif defined(CX_SSE2)
+			__m128i s0 = _mm_set1_epi8(specials[0]), s1 = _mm_set1_epi8(specials[1]);
+			__m128i s2 = _mm_set1_epi8(specials[2]), s3 = _mm_set1_epi8(specials[3]);
+			__m128i low = _mm_set1_epi8(controls ? 0x1F : 0);
+			for (; i + 32 <= n; i += 32) {
+				unsigned int m = 0;
+				for (int half = 0; half < 2; half++) {
+					__m128i v = _mm_loadu_si128((const __m128i*)(p + i + half * 16));
+					__m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, s0), _mm_cmpeq_epi8(v, s1)),
+						_mm_or_si128(_mm_cmpeq_epi8(v, s2), _mm_cmpeq_epi8(v, s3)));
+					if (controls) hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_max_epu8(v, low), low));
+					m |= (unsigned int)_mm_movemask_epi8(hit) << (half * 16);
 				}
+				if (m) return i + BitScan64(m);
 			}
-			else
-			{
-				dst += s[i];
+#endif
+			for (; i < n; i++) {
+				char c = p[i];
+				if (c == specials[0] || c == specials[1] || c == specials[2] || c == specials[3]) break;
+				if (controls && (unsigned char)c < 0x20) break;
 			}
+			return i;
 		}
 
-		if (!exceptEmpty || dst.size() > 0)
-		{
-			if (trimStr) cx::trim(dst);
-			*iter = dst;
+		template<typename TSink>
+		static void write_json(TSink& out, const char* p, size_t n) {
+			static const char specials[4] = { '"', '\\', '"', '\\' };
+			for (size_t i = 0; ; i++) {
+				size_t run = clean_prefix(p + i, n - i, specials, true);
+				out.append(p + i, run);
+				i += run;
+				if (i == n) return;
+
+				char esc[6] = { '\\', 0, '0', '0', 0, 0 };
+				size_t len = 2;
+				switch (p[i]) {
+				case '"': esc[1] = '"'; break;
+				case '\\': esc[1] = '\\'; break;
+				case '\b': esc[1] = 'b'; break;
+				case '\f': esc[1] = 'f'; break;
+				case '\n': esc[1] = 'n'; break;
+				case '\r': esc[1] = 'r'; break;
+				case '\t': esc[1] = 't'; break;
+				default:
+					esc[1] = 'u';
+					esc[4] = "0123456789abcdef"[(unsigned char)p[i] >> 4];
+					esc[5] = "0123456789abcdef"[p[i] & 0xF];
+					len = 6;
+					break;
+				}
+				out.append(esc, len);
+			}
 		}
-	}
 
-	void split(const std::string& s, const std::string& sep, std::vector<std::string>& strArray, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+		template<typename TSink>
+		static void write_csv(TSink& out, const char* p, size_t n, char sep) {
+			const char specials[4] = { sep, '"', '\r', '\n' };
+			if (clean_prefix(p, n, specials, false) == n) {
+				out.append(p, n);
+				return;
+			}
+
+			static const char quotes[4] = { '"', '"', '"', '"' };
+			out.append("\"", 1);
+			for (size_t i = 0; ; i++) {
+				size_t run = clean_prefix(p + i, n - i, quotes, false);
+				out.append(p + i, run);
+				i += run;
+				if (i == n) break;
+				out.append("\"\"", 2);
+			}
+			out.append("\"", 1);
+		}
+	};
+
+	void append_json_escaped(std::string& dst, string_view s)
 	{
-		strArray.clear();
-		split_str(s, std::back_insert_iterator<std::vector<std::string> >(strArray), sep, excludeEmpty, trimStr);
+		StringSink sink(dst);
+		EscapeHelper::write_json(sink, s.data(), s.size());
 	}
 
-	void split(const std::wstring& s, const std::wstring& sep, std::vector<std::wstring>& strArray, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	char* append_json_escaped(char* buffer, string_view s)
 	{
-		strArray.clear();
-		split_str(s, std::back_insert_iterator<std::vector<std::wstring> >(strArray), sep, excludeEmpty, trimStr);
+		BufferSink sink(buffer);
+		EscapeHelper::write_json(sink, s.data(), s.size());
+		*sink._End = '\0';
+		return sink._End;
 	}
 
-	void split(const std::string& s, const std::string& sep, std::list<std::string>& strList, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	void append_csv_quoted(std::string& dst, string_view s, char sep /*= ','*/)
 	{
-		strList.clear();
-		split_str(s, std::back_insert_iterator<std::list<std::string> >(strList), sep, excludeEmpty, trimStr);
+		StringSink sink(dst);
+		EscapeHelper::write_csv(sink, s.data(), s.size(), sep);
 	}
 
-	void split(const std::wstring& s, const std::wstring& sep, std::list<std::wstring>& strList, bool excludeEmpty /*= false*/, bool trimStr /*= false*/)
+	char* append_csv_quoted(char* buffer, string_view s, char sep /*= ','*/)
 	{
-		strList.clear();
-		split_str(s, std::back_insert_iterator<std::list<std::wstring> >(strList), sep, excludeEmpty, trimStr);
+		BufferSink sink(buffer);
+		EscapeHelper::write_csv(sink, s.data(), s.size(), sep);
+		*sink._End = '\0';
+		return sink._End;
 	}
 
+	//////////////////////////////////////////////////////////////////////////
+	// format() without vsnprintf for formats made only of %d %i %u %x %X %f %g %s %c %J %Q and %%.
+	// Formats using %J or %Q always come here; their other conversions go to snprintf one at a time.
+	class FormatHelper {
+	public:
+		struct Spec {
+			char conv;
+			char length;	// 0, 'h', 'H' (hh), 'l', 'L' (ll), 'j', 'z' or 't'
+			int precision;	// -1 if not given
+		};
+
+		// Parses the conversion after '%', returning the character after it; NULL if it has no fast writer.
+		static const char* parse(const char* p, Spec& spec) {
+			spec.length = 0;
+			spec.precision = -1;
+			if (*p == '.') {
+				p++;
+				spec.precision = 0;
+				for (; *p >= '0' && *p <= '9'; p++) {
+					if (spec.precision < 100) spec.precision = spec.precision * 10 + (*p - '0');
+				}
+				if (spec.precision > 99) return NULL;	// buf below is only sized for %.99f
+			}
+
+			switch (*p) {
+			case 'h': spec.length = p[1] == 'h' ? 'H' : 'h'; p += p[1] == 'h' ? 2 : 1; break;
+			case 'l': spec.length = p[1] == 'l' ? 'L' : 'l'; p += p[1] == 'l' ? 2 : 1; break;
+			case 'j': case 'z': case 't': spec.length = *p++; break;
+			}
+
+			spec.conv = *p;
+			switch (spec.conv) {
+			case 'd': case 'i': case 'u': case 'x': case 'X':
+				return spec.precision < 0 ? p + 1 : NULL;
+			case 'f': case 'g':
+				return spec.length == 0 || spec.length == 'l' ? p + 1 : NULL;
+			case 's': case 'c': case 'J': case 'Q': case '%':
+				return spec.length == 0 && spec.precision < 0 ? p + 1 : NULL;
+			default:
+				return NULL;
+			}
+		}
+
+		// Whether floats print with '.'; dotLocale caches the answer for one format call (-1 before it is read).
+		static bool point_is_dot(int& dotLocale) {
+			if (dotLocale < 0) dotLocale = CDecimalPoint()[0] == '.';
+			return dotLocale != 0;
+		}
+
+		// Whether every conversion has a fast writer, and floats would print with '.' in this locale.
+		static bool is_simple(const char* fmt, int& dotLocale) {
+			bool hasFloat = false;
+			for (const char* p = strchr(fmt, '%'); p != NULL; p = strchr(p, '%')) {
+				Spec spec;
+				p = parse(p + 1, spec);
+				if (p == NULL) return false;
+				hasFloat |= spec.conv == 'f' || spec.conv == 'g';
+			}
+			return !hasFloat || point_is_dot(dotLocale);
+		}
+
+		// Whether fmt has a %J or %Q conversion, which vsnprintf must never see.
+		static bool has_escapes(const char* fmt) {
+			for (const char* p = strchr(fmt, '%'); p != NULL; p = strchr(p, '%')) {
+				p++;
+				p += strspn(p, "-+ #0123456789.*hljztL");
+				if (*p == 'J' || *p == 'Q') return true;
+				if (*p != '\0') p++;
+			}
+			return false;
+		}
+
+		// Writes fmt up to the first conversion that cannot be formatted on its own (%n, positional
+		// arguments, %J or %Q with modifiers); the rest of fmt is dropped rather than guessed at.
+		template<typename TSink>
+		static void write(TSink& out, const char* fmt, va_list args, int& dotLocale) {
+			va_list ap;
+			va_copy(ap, args);
+			char buf[512];	// enough for %.99f of DBL_MAX
+			for (;;) {
+				const char* pct = strchr(fmt, '%');
+				if (pct == NULL) {
+					out.append(fmt, strlen(fmt));
+					break;
+				}
+				out.append(fmt, pct - fmt);
+
+				Spec spec;
+				const char* next = parse(pct + 1, spec);
+				if (next != NULL && (spec.conv == 'f' || spec.conv == 'g') && !point_is_dot(dotLocale)) next = NULL;
+				if (next == NULL) {
+					fmt = write_single(out, pct, ap, buf, sizeof(buf));
+					if (fmt == NULL) break;
+					continue;
+				}
+				fmt = next;
+				char* end = buf;
+				switch (spec.conv) {
+				case '%':
+					*end++ = '%';
+					break;
+				case 'c':
+					*end++ = (char)va_arg(ap, int);
+					break;
+				case 's': case 'J': case 'Q': {
+					const char* s = va_arg(ap, const char*);
+					if (s == NULL) s = "(null)";
+					if (spec.conv == 'J') EscapeHelper::write_json(out, s, strlen(s));
+					else if (spec.conv == 'Q') EscapeHelper::write_csv(out, s, strlen(s), ',');
+					else out.append(s, strlen(s));
+					break;
+				}
+				case 'd': case 'i':
+					end = NumberFormatHelper::write_int(buf, signed_arg(ap, spec.length));
+					break;
+				case 'u':
+					end = NumberFormatHelper::write_uint(buf, unsigned_arg(ap, spec.length));
+					break;
+				case 'x': case 'X':
+					end = NumberFormatHelper::write_hex(buf, unsigned_arg(ap, spec.length), spec.conv == 'X');
+					break;
+				default: {
+					double v = va_arg(ap, double);
+					int prec = spec.precision < 0 ? 6 : spec.precision;
+					end = v - v != 0 ? NULL : spec.conv == 'f' ? NumberFormatHelper::write_fixed(buf, v, prec)
+						: NumberFormatHelper::write_general(buf, v, prec);
+					if (end == NULL) {
+						char single[] = { '%', '.', '*', spec.conv, '\0' };
+						print(out, buf, sizeof(buf), single, &prec, 1, v);
+						end = buf;
+					}
+					break;
+				}
+				}
+				out.append(buf, end - buf);
+			}
+			va_end(ap);
+		}
+
+		// Formats the one conversion at pct with snprintf, returning the character after it;
+		// NULL if it cannot be handed over alone.
+		template<typename TSink>
+		static const char* write_single(TSink& out, const char* pct, va_list& ap, char* buf, size_t size) {
+			int stars[2], starCount = 0;
+			const char* p = pct + 1;
+			p += strspn(p, "-+ #0");
+			if (*p == '*') {
+				stars[starCount++] = va_arg(ap, int);
+				p++;
+			}
+			else {
+				while (*p >= '0' && *p <= '9') p++;
+			}
+			if (*p == '.') {
+				p++;
+				if (*p == '*') {
+					stars[starCount++] = va_arg(ap, int);
+					p++;
+				}
+				else {
+					while (*p >= '0' && *p <= '9') p++;
+				}
+			}
+
+			// The flags, width and precision are kept; the length is rewritten to match the value passed on.
+			char single[32];
+			size_t prefix = p - pct;
+			if (prefix + 3 >= sizeof(single)) return NULL;
+			memcpy(single, pct, prefix);
+			char* q = single + prefix;
+
+			char length = 0;
+			switch (*p) {
+			case 'h': length = p[1] == 'h' ? 'H' : 'h'; p += p[1] == 'h' ? 2 : 1; break;
+			case 'l': length = p[1] == 'l' ? 'L' : 'l'; p += p[1] == 'l' ? 2 : 1; break;
+			case 'L': length = 'D'; p++; break;
+			case 'j': case 'z': case 't': length = *p++; break;
+			}
+
+			char conv = *p;
+			switch (conv) {
+			case 'd': case 'i':
+				if (length == 'D') return NULL;
+				*q++ = 'l'; *q++ = 'l'; *q++ = conv; *q = '\0';
+				print(out, buf, size, single, stars, starCount, signed_arg(ap, length));
+				break;
+			case 'o': case 'u': case 'x': case 'X':
+				if (length == 'D') return NULL;
+				*q++ = 'l'; *q++ = 'l'; *q++ = conv; *q = '\0';
+				print(out, buf, size, single, stars, starCount, unsigned_arg(ap, length));
+				break;
+			case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+				if (length == 'D') {
+					*q++ = 'L'; *q++ = conv; *q = '\0';
+					print(out, buf, size, single, stars, starCount, va_arg(ap, long double));
+				}
+				else if (length == 0 || length == 'l') {
+					*q++ = conv; *q = '\0';
+					print(out, buf, size, single, stars, starCount, va_arg(ap, double));
+				}
+				else return NULL;
+				break;
+			case 'c':
+				if (length == 'l') {
+					*q++ = 'l'; *q++ = conv; *q = '\0';
+					print(out, buf, size, single, stars, starCount, va_arg(ap, wint_t));
+				}
+				else if (length == 0) {
+					*q++ = conv; *q = '\0';
+					print(out, buf, size, single, stars, starCount, va_arg(ap, int));
+				}
+				else return NULL;
+				break;
+			case 's':
+				if (length == 'l') {
+					const wchar_t* ws = va_arg(ap, const wchar_t*);
+					*q++ = 'l'; *q++ = conv; *q = '\0';
+					print(out, buf, size, single, stars, starCount, ws == NULL ? L"(null)" : ws);
+				}
+				else if (length == 0) {
+					const char* s = va_arg(ap, const char*);
+					*q++ = conv; *q = '\0';
+					print(out, buf, size, single, stars, starCount, s == NULL ? "(null)" : s);
+				}
+				else return NULL;
+				break;
+			case 'p':
+				if (length != 0) return NULL;
+				*q++ = conv; *q = '\0';
+				print(out, buf, size, single, stars, starCount, va_arg(ap, void*));
+				break;
+			default:
+				return NULL;
+			}
+			return p + 1;
+		}
+
+		template<typename TSink, typename T>
+		static void print(TSink& out, char* buf, size_t size, const char* single, const int* stars, int starCount, T value) {
+			std::string big;
+			for (;;) {
+				int n = starCount == 0 ? snprintf(buf, size, single, value)
+					: starCount == 1 ? snprintf(buf, size, single, stars[0], value)
+					: snprintf(buf, size, single, stars[0], stars[1], value);
+				if (n < 0) return;
+				if ((size_t)n < size) {
+					out.append(buf, n);
+					return;
+				}
+				big.resize(n + 1);
+				buf = &big[0];
+				size = big.size();
+			}
+		}
+
+		static long long signed_arg(va_list& args, char length) {
+			switch (length) {
+			case 'h': return (short)va_arg(args, int);
+			case 'H': return (signed char)va_arg(args, int);
+			case 'l': return va_arg(args, long);
+			case 'L': return va_arg(args, long long);
+			case 'j': return va_arg(args, intmax_t);
+			case 'z': return (long long)va_arg(args, size_t);
+			case 't': return va_arg(args, ptrdiff_t);
+			default: return va_arg(args, int);
+			}
+		}
+
+		static unsigned long long unsigned_arg(va_list& args, char length) {
+			switch (length) {
+			case 'h': return (unsigned short)va_arg(args, unsigned int);
+			case 'H': return (unsigned char)va_arg(args, unsigned int);
+			case 'l': return va_arg(args, unsigned long);
+			case 'L': return va_arg(args, unsigned long long);
+			case 'j': return va_arg(args, uintmax_t);
+			case 'z': return va_arg(args, size_t);
+			case 't': return (unsigned long long)va_arg(args, ptrdiff_t);
+			default: return va_arg(args, unsigned int);
+			}
+		}
+	};
+
 	void format_args(const char* fmt, va_list args, std::string& dstStr)
 	{
 		if (fmt == 0) {
 			return;
 		}
 
+		int dotLocale = -1;
+		if (FormatHelper::is_simple(fmt, dotLocale) || FormatHelper::has_escapes(fmt)) {
+			dstStr.clear();
+			StringSink sink(dstStr);
+			FormatHelper::write(sink, fmt, args, dotLocale);
+			return;
+		}
+
 		va_list args2;
 		va_copy(args2, args);
 		size_t nLength = vsnprintf(NULL, 0, fmt, args2);
@@ -590,6 +5093,14 @@ namespace cx {
 		if (fmt == NULL || buffer == NULL)
 			return buffer;
 
+		int dotLocale = -1;
+		if (FormatHelper::is_simple(fmt, dotLocale) || FormatHelper::has_escapes(fmt)) {
+			BufferSink sink(buffer);
+			FormatHelper::write(sink, fmt, args, dotLocale);
+			*sink._End = '\0';
+			return buffer;
+		}
+
 		vsprintf(buffer, fmt, args);
 		return buffer;
 	}
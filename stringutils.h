@@ -26,14 +26,343 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <algorithm>
+#include <utility>
+#include <locale>
 #include <stdarg.h>
+#include <stdio.h>
+#include <functional>
 
 /** namespace cx */
 namespace cx {
 
-	bool cstarts_with(const char* src, const char* dst, bool ignoreCase = false);
-	bool cends_with(const char* src, const char* dst, bool ignoreCase = false);
-	bool ccontains(const char* src, const char* dst, bool ignoreCase = false);
+	/**
+	 * @brief Case conversion tables cached for a locale.
+	 *
+	 * Looks up the ctype facets once and prebuilds fold tables for narrow chars and for
+	 * the ASCII range of wide chars, so case-insensitive APIs do not construct a
+	 * std::locale per call. A context is immutable after construction and can be shared
+	 * between threads. APIs taking the default global() context keep the global locale they
+	 * first saw until refresh_global() is called.
+	 */
+	class CaseContext {
+	public:
+		/**
+		 * @brief Build a context for the current global locale.
+		 */
+		CaseContext();
+
+		/**
+		 * @brief Build a context for the given locale.
+		 * @param loc Locale whose ctype facets are used.
+		 */
+		explicit CaseContext(const std::locale& loc);
+
+		/**
+		 * @brief Shared context of the global locale, a single atomic load per call.
+		 *
+		 * Built from std::locale() on first use; call refresh_global() after std::locale::global()
+		 * to pick up the new locale.
+		 * @return The shared context.
+		 */
+		static const CaseContext& global();
+
+		/**
+		 * @brief Rebuild the shared context from the current global locale.
+		 *
+		 * Later global() calls return the new context. Contexts returned earlier stay valid and keep
+		 * their locale; one context is kept per distinct locale and freed at exit.
+		 * @return The new shared context.
+		 */
+		static const CaseContext& refresh_global();
+
+		/** @brief Locale the tables were built from. */
+		const std::locale& locale() const { return _Loc; }
+
+		char to_lower(char c) const { return (char)_Lower[(unsigned char)c]; }
+		char to_upper(char c) const { return (char)_Upper[(unsigned char)c]; }
+
+		wchar_t to_lower(wchar_t c) const {
+			return (unsigned long)c < 128 ? _WLower[c] : _WCType->tolower(c);
+		}
+
+		wchar_t to_upper(wchar_t c) const {
+			return (unsigned long)c < 128 ? _WUpper[c] : _WCType->toupper(c);
+		}
+
+		/** @brief Narrow lowercase table indexed by unsigned char. */
+		const unsigned char* lower_table() const { return _Lower; }
+
+		/** @brief Narrow uppercase table indexed by unsigned char. */
+		const unsigned char* upper_table() const { return _Upper; }
+
+		/** @brief Whether wide ASCII maps only A-Z and a-z to each other, as in the C locale. */
+		bool wide_ascii_simple() const { return _WAsciiSimple; }
+
+	private:
+		void init();
+
+		std::locale _Loc;
+		const std::ctype<wchar_t>* _WCType;
+		unsigned char _Lower[256];
+		unsigned char _Upper[256];
+		wchar_t _WLower[128];
+		wchar_t _WUpper[128];
+		bool _WAsciiSimple;
+	};
+
+	/**
+	 * @brief Non-owning view of a character sequence, usable before C++17's std::basic_string_view.
+	 *
+	 * The viewed characters must outlive the view.
+	 */
+	template<typename TChar>
+	class basic_string_view {
+	public:
+		typedef const TChar* const_iterator;
+		static const size_t npos = (size_t)-1;
+
+		basic_string_view() : _Data(NULL), _Size(0) {}
+		basic_string_view(const TChar* data, size_t size) : _Data(data), _Size(size) {}
+		basic_string_view(const TChar* s) : _Data(s), _Size(std::char_traits<TChar>::length(s)) {}
+		basic_string_view(const std::basic_string<TChar>& s) : _Data(s.data()), _Size(s.size()) {}
+
+		const TChar* data() const { return _Data; }
+		size_t size() const { return _Size; }
+		size_t length() const { return _Size; }
+		bool empty() const { return _Size == 0; }
+		const_iterator begin() const { return _Data; }
+		const_iterator end() const { return _Data + _Size; }
+		const TChar& operator[](size_t i) const { return _Data[i]; }
+
+		basic_string_view substr(size_t pos, size_t n = npos) const {
+			if (pos > _Size) pos = _Size;
+			return basic_string_view(_Data + pos, std::min(n, _Size - pos));
+		}
+
+		int compare(const basic_string_view& other) const {
+			int r = std::char_traits<TChar>::compare(_Data, other._Data, std::min(_Size, other._Size));
+			return r != 0 ? r : (_Size < other._Size ? -1 : _Size > other._Size ? 1 : 0);
+		}
+
+		size_t find(const basic_string_view& s, size_t pos = 0) const {
+			if (pos > _Size || s._Size > _Size - pos) return npos;
+			const TChar* it = std::search(_Data + pos, _Data + _Size, s._Data, s._Data + s._Size);
+			return it == _Data + _Size && s._Size != 0 ? npos : (size_t)(it - _Data);
+		}
+
+		std::basic_string<TChar> str() const { return std::basic_string<TChar>(_Data, _Size); }
+
+		bool operator==(const basic_string_view& other) const { return _Size == other._Size && compare(other) == 0; }
+		bool operator!=(const basic_string_view& other) const { return !(*this == other); }
+		bool operator<(const basic_string_view& other) const { return compare(other) < 0; }
+
+	private:
+		const TChar* _Data;
+		size_t _Size;
+	};
+
+	template<typename TChar>
+	const size_t basic_string_view<TChar>::npos;
+
+	typedef basic_string_view<char> string_view;
+	typedef basic_string_view<wchar_t> wstring_view;
+
+	template<unsigned int W>
+	inline constexpr unsigned long long char_set_word() { return 0; }
+
+	// Bits of the 64-character block W of a character set, computed at compile time.
+	template<unsigned int W, char C, char... Rest>
+	inline constexpr unsigned long long char_set_word() {
+		return ((unsigned int)(unsigned char)C >> 6 == W ? 1ULL << ((unsigned char)C & 63) : 0ULL) | char_set_word<W, Rest...>();
+	}
+
+	/**
+	 * @brief Character set fixed at compile time, such as CharSet<' ', '\t'>.
+	 *
+	 * Membership is one shift and mask of a 256-bit constant, without a loop over the members.
+	 * Wide characters above 0xFF are never members. A set of one character searches with
+	 * std::char_traits::find (memchr).
+	 */
+	template<char... Cs>
+	struct CharSet {
+		static bool contains(char c) { return test((unsigned char)c); }
+		static bool contains(wchar_t c) { return (unsigned int)c < 256 && test((unsigned int)c); }
+
+		/**
+		 * @brief Removes the leading characters of the set.
+		 * @param src Source string for trimming.
+		 */
+		template<typename TStr>
+		static void trim_start(TStr& src) {
+			size_t i = 0;
+			while (i < src.size() && contains(src[i])) i++;
+			src.erase(0, i);
+		}
+
+		/**
+		 * @brief Removes the trailing characters of the set.
+		 * @param src Source string for trimming.
+		 */
+		template<typename TStr>
+		static void trim_end(TStr& src) {
+			size_t n = src.size();
+			while (n > 0 && contains(src[n - 1])) n--;
+			src.erase(n);
+		}
+
+		/**
+		 * @brief Removes the leading and trailing characters of the set.
+		 * @param src Source string for trimming.
+		 */
+		template<typename TStr>
+		static void trim(TStr& src) {
+			trim_end(src);
+			trim_start(src);
+		}
+
+		/**
+		 * @brief Splits a string at every character of the set, like split().
+		 * @param s Input string.
+		 * @param strArray Container (vector or list) for saving the substrings.
+		 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+		 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+		 */
+		template<typename TStr, typename TContainer>
+		static void split(const TStr& s, TContainer& strArray, bool excludeEmpty = false, bool trimStr = false) {
+			static_assert(sizeof...(Cs) > 0, "split needs at least one separator");
+
+			strArray.clear();
+			if (s.empty()) return;
+
+			typedef typename TStr::value_type TChar;
+			const TChar* end = s.data() + s.size();
+			for (const TChar* p = s.data();; ) {
+				const TChar* q = find(p, end);
+				if (!excludeEmpty || q != p) {
+					strArray.push_back(TStr(p, q));
+					if (trimStr) CharSet<'\t', '\n', '\v', '\f', '\r', ' '>::trim(strArray.back());
+				}
+				if (q == end) break;
+				p = q + 1;
+			}
+		}
+
+	private:
+		static bool test(unsigned int u) {
+			unsigned long long m = u < 128 ? (u < 64 ? char_set_word<0, Cs...>() : char_set_word<1, Cs...>())
+				: (u < 192 ? char_set_word<2, Cs...>() : char_set_word<3, Cs...>());
+			return ((m >> (u & 63)) & 1) != 0;
+		}
+
+		template<typename TChar>
+		static const TChar* find(const TChar* p, const TChar* end) {
+			if (sizeof...(Cs) == 1) {
+				const char cs[] = { Cs..., 0 };
+				const TChar* q = std::char_traits<TChar>::find(p, end - p, (TChar)(unsigned char)cs[0]);
+				return q != NULL ? q : end;
+			}
+			while (p < end && !contains(*p)) p++;
+			return p;
+		}
+	};
+
+	/** @brief The white-space characters trimmed by default. */
+	typedef CharSet<'\t', '\n', '\v', '\f', '\r', ' '> SpaceChars;
+
+	/**
+	 * @brief Trim the characters given as template arguments, e.g. trim<' ', '\\t'>(s).
+	 * @param src Source string for trimming.
+	 */
+	template<char... Cs>
+	inline void trim(std::string& src) { CharSet<Cs...>::trim(src); }
+
+	/**
+	 * @brief Trim the characters given as template arguments, e.g. trim<' ', '\\t'>(s).
+	 * @param src Source string for trimming.
+	 */
+	template<char... Cs>
+	inline void trim(std::wstring& src) { CharSet<Cs...>::trim(src); }
+
+	/**
+	 * @brief Removes the leading characters given as template arguments.
+	 * @param src Source string for trimming.
+	 */
+	template<char... Cs>
+	inline void trim_start(std::string& src) { CharSet<Cs...>::trim_start(src); }
+
+	/**
+	 * @brief Removes the leading characters given as template arguments.
+	 * @param src Source string for trimming.
+	 */
+	template<char... Cs>
+	inline void trim_start(std::wstring& src) { CharSet<Cs...>::trim_start(src); }
+
+	/**
+	 * @brief Removes the trailing characters given as template arguments.
+	 * @param src Source string for trimming.
+	 */
+	template<char... Cs>
+	inline void trim_end(std::string& src) { CharSet<Cs...>::trim_end(src); }
+
+	/**
+	 * @brief Removes the trailing characters given as template arguments.
+	 * @param src Source string for trimming.
+	 */
+	template<char... Cs>
+	inline void trim_end(std::wstring& src) { CharSet<Cs...>::trim_end(src); }
+
+	/**
+	 * @brief Splits a string at the separators given as template arguments, e.g. split<','>(s, fields).
+	 * @param s Input string.
+	 * @param strArray Container for saving the substrings.
+	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 */
+	template<char... Cs>
+	inline void split(const std::string& s, std::vector<std::string>& strArray, bool excludeEmpty = false, bool trimStr = false) {
+		CharSet<Cs...>::split(s, strArray, excludeEmpty, trimStr);
+	}
+
+	/**
+	 * @brief Splits a string at the separators given as template arguments, e.g. split<','>(s, fields).
+	 * @param s Input string.
+	 * @param strArray Container for saving the substrings.
+	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 */
+	template<char... Cs>
+	inline void split(const std::wstring& s, std::vector<std::wstring>& strArray, bool excludeEmpty = false, bool trimStr = false) {
+		CharSet<Cs...>::split(s, strArray, excludeEmpty, trimStr);
+	}
+
+	/**
+	 * @brief Splits a string at the separators given as template arguments, e.g. split<','>(s, fields).
+	 * @param s Input string.
+	 * @param strArray Container for saving the substrings.
+	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 */
+	template<char... Cs>
+	inline void split(const std::string& s, std::list<std::string>& strArray, bool excludeEmpty = false, bool trimStr = false) {
+		CharSet<Cs...>::split(s, strArray, excludeEmpty, trimStr);
+	}
+
+	/**
+	 * @brief Splits a string at the separators given as template arguments, e.g. split<','>(s, fields).
+	 * @param s Input string.
+	 * @param strArray Container for saving the substrings.
+	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 */
+	template<char... Cs>
+	inline void split(const std::wstring& s, std::list<std::wstring>& strArray, bool excludeEmpty = false, bool trimStr = false) {
+		CharSet<Cs...>::split(s, strArray, excludeEmpty, trimStr);
+	}
+
+	bool cstarts_with(const char* src, const char* dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+	bool cends_with(const char* src, const char* dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+	bool ccontains(const char* src, const char* dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Trim the input string.
@@ -254,197 +583,1747 @@ namespace cx {
 	 */
 	std::wstring trim_end_copy(const std::wstring& src, const std::wstring& trimChars);
 
+	/**
+	 * @brief Trim the string and collapse every internal run of white-space characters into one space.
+	 * @param src The string to normalize.
+	 */
+	void normalize_space(std::string& src);
+
+	/**
+	 * @brief Trim and collapse white-space runs of the string, saving the result to another one.
+	 * @param src Source string.
+	 * @param dst Target string, may be the source string itself.
+	 */
+	void normalize_space(const std::string& src, std::string& dst);
+
+	/**
+	 * @brief Trim and collapse white-space runs of the string, saving the result to another one.
+	 * @param src Source string.
+	 * @param dst Target string, may be the source string itself.
+	 * @param spaceChars Chars list treated as white-space.
+	 */
+	void normalize_space(const std::string& src, std::string& dst, const std::string& spaceChars);
+
+	/**
+	 * @brief Trim and collapse white-space runs of the string and return to caller.
+	 * @param src Source string.
+	 * @return Normalized string.
+	 */
+	std::string normalize_space_copy(const std::string& src);
+
+	/**
+	 * @brief Trim and collapse white-space runs of the string and return to caller.
+	 * @param src Source string.
+	 * @param spaceChars Chars list treated as white-space.
+	 * @return Normalized string.
+	 */
+	std::string normalize_space_copy(const std::string& src, const std::string& spaceChars);
+
+	/**
+	 * @brief Trim the string and collapse every internal run of white-space characters into one space.
+	 * @param src The string to normalize.
+	 */
+	void normalize_space(std::wstring& src);
+
+	/**
+	 * @brief Trim and collapse white-space runs of the string, saving the result to another one.
+	 * @param src Source string.
+	 * @param dst Target string, may be the source string itself.
+	 */
+	void normalize_space(const std::wstring& src, std::wstring& dst);
+
+	/**
+	 * @brief Trim and collapse white-space runs of the string, saving the result to another one.
+	 * @param src Source string.
+	 * @param dst Target string, may be the source string itself.
+	 * @param spaceChars Chars list treated as white-space.
+	 */
+	void normalize_space(const std::wstring& src, std::wstring& dst, const std::wstring& spaceChars);
+
+	/**
+	 * @brief Trim and collapse white-space runs of the string and return to caller.
+	 * @param src Source string.
+	 * @return Normalized string.
+	 */
+	std::wstring normalize_space_copy(const std::wstring& src);
+
+	/**
+	 * @brief Trim and collapse white-space runs of the string and return to caller.
+	 * @param src Source string.
+	 * @param spaceChars Chars list treated as white-space.
+	 * @return Normalized string.
+	 */
+	std::wstring normalize_space_copy(const std::wstring& src, const std::wstring& spaceChars);
+
 	/**
 	 * @brief Determines whether the first string and the second string have the same value.
 	 * @param src First string.
 	 * @param dst Second string.
 	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 * @return Whether the first string and the second string have the same value.
 	 */
-	bool equals(const std::string& src, const std::string& dst, bool ignoreCase = false);
+	bool equals(const std::string& src, const std::string& dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Determines whether the first string and the second string have the same value.
 	 * @param src First string.
 	 * @param dst Second string.
 	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 * @return Whether the first string and the second string have the same value.
 	 */
-	bool equals(const std::wstring& src, const std::wstring& dst, bool ignoreCase = false);
+	bool equals(const std::wstring& src, const std::wstring& dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Compares two strings by character code.
+	 * @param src First string.
+	 * @param dst Second string.
+	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return Negative if the first string sorts before the second one, 0 if equal, positive otherwise.
+	 */
+	int compare(const std::string& src, const std::string& dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Compares two strings in natural order, where runs of digits compare by numeric value ("a2" < "a10").
+	 * @param src First string.
+	 * @param dst Second string.
+	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return Negative if the first string sorts before the second one, 0 if equal, positive otherwise.
+	 */
+	int compare_natural(const std::string& src, const std::string& dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Builds a byte key whose plain (memcmp) order equals compare() or compare_natural() order of the source strings.
+	 * @param src Source string.
+	 * @param ignoreCase true for the key of a case-insensitive comparison; otherwise, false.
+	 * @param natural true for the key of natural order; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return The sort key.
+	 */
+	std::string make_sort_key(const std::string& src, bool ignoreCase = false, bool natural = false, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Compares two strings by character code.
+	 * @param src First string.
+	 * @param dst Second string.
+	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return Negative if the first string sorts before the second one, 0 if equal, positive otherwise.
+	 */
+	int compare(const std::wstring& src, const std::wstring& dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Compares two strings in natural order, where runs of digits compare by numeric value ("a2" < "a10").
+	 * @param src First string.
+	 * @param dst Second string.
+	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return Negative if the first string sorts before the second one, 0 if equal, positive otherwise.
+	 */
+	int compare_natural(const std::wstring& src, const std::wstring& dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Builds a byte key whose plain (memcmp) order equals compare() or compare_natural() order of the source strings.
+	 * @param src Source string.
+	 * @param ignoreCase true for the key of a case-insensitive comparison; otherwise, false.
+	 * @param natural true for the key of natural order; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return The sort key.
+	 */
+	std::string make_sort_key(const std::wstring& src, bool ignoreCase = false, bool natural = false, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Determines whether the first string starts with the second string.
 	 * @param src First string.
 	 * @param dst Second string.
 	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 * @return Whether the first string starts with the second string.
 	 */
-	bool starts_with(const std::string& src, const std::string& dst, bool ignoreCase = false);
+	bool starts_with(const std::string& src, const std::string& dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Determines whether the first string starts with the second string.
 	 * @param src First string.
 	 * @param dst Second string.
 	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 * @return Whether the first string starts with the second string.
 	 */
-	bool starts_with(const std::wstring& src, const std::wstring& dst, bool ignoreCase = false);
+	bool starts_with(const std::wstring& src, const std::wstring& dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Determines whether the end of first string matches the second string.
 	 * @param src First string.
 	 * @param dst Second string.
 	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 * @return Whether the end of first string matches the second string.
 	 */
-	bool ends_with(const std::string& src, const std::string& dst, bool ignoreCase = false);
+	bool ends_with(const std::string& src, const std::string& dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Determines whether the end of first string matches the second string.
 	 * @param src First string.
 	 * @param dst Second string.
 	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 * @return Whether the end of first string matches the second string.
 	 */
-	bool ends_with(const std::wstring& src, const std::wstring& dst, bool ignoreCase = false);
+	bool ends_with(const std::wstring& src, const std::wstring& dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Returns a value indicating whether the second string occurs within the first string.
 	 * @param src First string.
 	 * @param dst Second string.
 	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 * @return true if the second string occurs within the first string, or if the second string is the empty string (""); otherwise, false.
 	 */
-	bool contains(const std::string& src, const std::string& dst, bool ignoreCase = false);
+	bool contains(const std::string& src, const std::string& dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Returns a value indicating whether the second string occurs within the first string.
 	 * @param src First string.
 	 * @param dst Second string.
 	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 * @return true if the second string occurs within the first string, or if the second string is the empty string (""); otherwise, false.
 	 */
-	bool contains(const std::wstring& src, const std::wstring& dst, bool ignoreCase = false);
+	bool contains(const std::wstring& src, const std::wstring& dst, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Check whether the string contains a substring within k edits (insertions, deletions or substitutions) of the needle.
+	 * @param src Source string.
+	 * @param needle The string to search for, needles up to 64 characters are matched in linear time.
+	 * @param k Maximum number of edits.
+	 * @param ignoreCase true to ignore case when matching; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return true if found; otherwise, false.
+	 */
+	bool contains_approx(const std::string& src, const std::string& needle, size_t k, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Replaces all non-overlapping occurrences of a string, scanning from the left.
+	 *
+	 * Runs in place when the replacement is not longer than the searched string.
+	 * @param src String to modify.
+	 * @param from String to be replaced, nothing is replaced if it is empty.
+	 * @param to Replacement string.
+	 * @param ignoreCase true to ignore case when searching; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return Number of replacements.
+	 */
+	size_t replace_all(std::string& src, const std::string& from, const std::string& to, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Replaces all non-overlapping occurrences of a string, scanning from the left.
+	 *
+	 * Runs in place when the replacement is not longer than the searched string.
+	 * @param src String to modify.
+	 * @param from String to be replaced, nothing is replaced if it is empty.
+	 * @param to Replacement string.
+	 * @param ignoreCase true to ignore case when searching; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return Number of replacements.
+	 */
+	size_t replace_all(std::wstring& src, const std::wstring& from, const std::wstring& to, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Return a copy of the input string with all occurrences of a string replaced.
+	 * @param src Source string.
+	 * @param from String to be replaced, nothing is replaced if it is empty.
+	 * @param to Replacement string.
+	 * @param ignoreCase true to ignore case when searching; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return The replaced string.
+	 */
+	std::string replace_all_copy(const std::string& src, const std::string& from, const std::string& to, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Return a copy of the input string with all occurrences of a string replaced.
+	 * @param src Source string.
+	 * @param from String to be replaced, nothing is replaced if it is empty.
+	 * @param to Replacement string.
+	 * @param ignoreCase true to ignore case when searching; otherwise, false.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return The replaced string.
+	 */
+	std::wstring replace_all_copy(const std::wstring& src, const std::wstring& from, const std::wstring& to, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Replaces several strings in one pass over the input.
+	 *
+	 * At every position the longest matching pattern is replaced and scanning resumes after it.
+	 * The case context must outlive the replacer.
+	 */
+	class Replacer {
+	public:
+		/**
+		 * @brief Create an empty replacer.
+		 * @param ignoreCase true to ignore case when matching; otherwise, false.
+		 * @param ctx Case conversion context, the shared context of the global locale by default.
+		 */
+		explicit Replacer(bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+		/**
+		 * @brief Add a replacement pair, empty patterns are ignored.
+		 * @param from String to be replaced.
+		 * @param to Replacement string.
+		 * @return This replacer.
+		 */
+		Replacer& add(const std::string& from, const std::string& to);
+
+		/**
+		 * @brief Replace all patterns of src and save the result to dst.
+		 * @param src Source string.
+		 * @param dst Target string.
+		 * @return Number of replacements.
+		 */
+		size_t apply(const std::string& src, std::string& dst) const;
+
+		/**
+		 * @brief Replace all patterns of the string, in place if no replacement is longer than its pattern.
+		 * @param src String to modify.
+		 * @return Number of replacements.
+		 */
+		size_t apply(std::string& src) const;
+
+		/**
+		 * @brief Return a copy of the input string with all patterns replaced.
+		 * @param src Source string.
+		 * @return The replaced string.
+		 */
+		std::string apply_copy(const std::string& src) const;
+
+	private:
+		unsigned char fold(char c) const { return _IgnoreCase ? (unsigned char)_Ctx->to_lower(c) : (unsigned char)c; }
+		size_t match(const char* s, size_t n, size_t& pairIdx) const;
+
+		std::vector<std::pair<std::string, std::string> > _Pairs;
+		std::vector<size_t> _ByFirst[256];
+		unsigned char _First[256];
+		bool _IgnoreCase;
+		const CaseContext* _Ctx;
+		bool _ShrinkOnly;
+	};
+
+	/**
+	 * @brief Compiled wildcard pattern supporting '*', '?', character classes and backslash escapes.
+	 *
+	 * Classes are written as [abc], [a-z] or [!a-z] (also [^a-z]); a '[' without closing ']' is literal.
+	 * The pattern is split at every '*' into fixed-length segments which are placed leftmost-first,
+	 * so matching never backtracks.
+	 */
+	class Glob {
+	public:
+		/**
+		 * @brief Compile a pattern.
+		 * @param pattern The wildcard pattern, an empty pattern only matches empty strings.
+		 * @param ignoreCase true to ignore case when matching; otherwise, false.
+		 * @param ctx Case conversion context, the shared context of the global locale by default.
+		 */
+		explicit Glob(const std::string& pattern = std::string(), bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+		/**
+		 * @brief Check whether the whole string matches the pattern.
+		 * @param s The string to check.
+		 * @return true if the string matches; otherwise, false.
+		 */
+		bool match(string_view s) const;
+
+		/**
+		 * @brief The source pattern.
+		 */
+		const std::string& pattern() const { return _Pattern; }
+
+	private:
+		struct Segment {
+			size_t first;		// index of the first set in _Sets
+			size_t count;
+			std::string text;	// the characters, if every one is a literal
+			bool literal;
+		};
+
+		void add_set(const unsigned long long set[4], char c, bool literal);
+		bool match_at(const Segment& seg, const char* p) const;
+		size_t find(const Segment& seg, string_view s, size_t pos) const;
+
+		std::string _Pattern;
+		std::vector<Segment> _Segments;
+		std::vector<unsigned long long> _Sets;	// 256-bit accepted byte set per pattern character
+		size_t _MinLength;
+		bool _IgnoreCase;
+		const CaseContext* _Ctx;
+	};
+
+	/**
+	 * @brief A needle occurrence found by StreamSearcher.
+	 */
+	struct StreamMatch {
+		unsigned long long offset;	// stream offset of the first byte of the match
+		size_t needle;				// index of the needle, in the order they were added
+	};
+
+	/**
+	 * @brief Finds needles in a byte stream delivered in chunks, including matches that straddle chunks.
+	 *
+	 * All needles are compiled into one automaton, the state carried between chunks is a single
+	 * integer, so memory does not grow with the length of the stream.
+	 */
+	class StreamSearcher {
+	public:
+		/**
+		 * @brief Create a searcher without needles.
+		 * @param ignoreCase true to ignore case when matching; otherwise, false.
+		 * @param ctx Case conversion context, the shared context of the global locale by default.
+		 */
+		explicit StreamSearcher(bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+		/**
+		 * @brief Create a searcher for a single needle.
+		 * @param needle The string to search for.
+		 * @param ignoreCase true to ignore case when matching; otherwise, false.
+		 * @param ctx Case conversion context, the shared context of the global locale by default.
+		 */
+		explicit StreamSearcher(const std::string& needle, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+		/**
+		 * @brief Create a searcher for a single needle.
+		 * @param needle The string to search for.
+		 * @param ignoreCase true to ignore case when matching; otherwise, false.
+		 * @param ctx Case conversion context, the shared context of the global locale by default.
+		 */
+		explicit StreamSearcher(const char* needle, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+		/**
+		 * @brief Add a needle, empty needles are ignored. Needles added mid-stream only match data fed afterwards.
+		 * @param needle The string to search for.
+		 * @return This searcher.
+		 */
+		StreamSearcher& add(const std::string& needle);
+
+		/**
+		 * @brief Scan the next chunk of the stream.
+		 * @param data Chunk data.
+		 * @param len Chunk length.
+		 * @param matches Container the matches ending in this chunk are appended to.
+		 * @return Number of matches ending in this chunk.
+		 */
+		size_t feed(const char* data, size_t len, std::vector<StreamMatch>& matches);
+
+		/**
+		 * @brief Start a new stream at offset 0, keeping the needles.
+		 */
+		void reset();
+
+		/**
+		 * @brief Number of bytes fed since the stream started.
+		 */
+		unsigned long long offset() const { return _Offset; }
+
+	private:
+		void build();
+
+		std::vector<std::string> _Needles;
+		std::vector<unsigned int> _Next;	// 256 transitions per state
+		std::vector<size_t> _Output;		// needle ending at the state, or npos
+		std::vector<unsigned int> _Link;	// nearest proper suffix state with output, 0 for none
+		unsigned int _State;
+		unsigned long long _Offset;
+		bool _Dirty;
+		bool _IgnoreCase;
+		const CaseContext* _Ctx;
+	};
+
+	/**
+	 * @brief Compiled needle for approximate substring search by edit distance.
+	 *
+	 * Needles up to 64 characters run Myers' bit-parallel algorithm, one machine word step per
+	 * haystack character. Longer needles fall back to a column-by-column dynamic program.
+	 */
+	class ApproxMatcher {
+	public:
+		/**
+		 * @brief Compile a needle.
+		 * @param needle The string to search for.
+		 * @param ignoreCase true to ignore case when matching; otherwise, false.
+		 * @param ctx Case conversion context, the shared context of the global locale by default.
+		 */
+		explicit ApproxMatcher(const std::string& needle = std::string(), bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+		/**
+		 * @brief Check whether the string contains a substring within k edits of the needle.
+		 * @param s The string to search.
+		 * @param k Maximum number of edits.
+		 * @return true if found; otherwise, false.
+		 */
+		bool contains(string_view s, size_t k) const;
+
+		/**
+		 * @brief Smallest edit distance between the needle and any substring of the string.
+		 * @param s The string to search.
+		 * @return The distance, at most the needle length.
+		 */
+		size_t distance(string_view s) const;
+
+	private:
+		size_t scan(string_view s, size_t k) const;
+
+		std::string _Needle;
+		unsigned long long _Peq[256];	// bit i set if the byte matches needle[i]
+		bool _IgnoreCase;
+		const CaseContext* _Ctx;
+	};
 
 	/**
 	 * @brief Convert the string to lowercase.
 	 * @param src The string to convert.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 */
-	void to_lower(std::string& src);
+	void to_lower(std::string& src, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Convert the string to lowercase.
 	 * @param src The string to convert.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 */
-	void to_lower(std::wstring& src);
+	void to_lower(std::wstring& src, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Convert the first string to lowercase and save to the second one.
 	 * @param src The string to convert.
 	 * @param dst The string to save the result.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 */
-	void to_lower(const std::string& src, std::string& dst);
+	void to_lower(const std::string& src, std::string& dst, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Convert the first string to lowercase and save to the second one.
 	 * @param src The string to convert.
 	 * @param dst The string to save the result.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 */
-	void to_lower(const std::wstring& src, std::wstring& dst);
+	void to_lower(const std::wstring& src, std::wstring& dst, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Return a copy of the input string converted to lowercase.
 	 * @param src The string to convert.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 * @return The converted string.
 	 */
-	std::string to_lower_copy(const std::string& src);
+	std::string to_lower_copy(const std::string& src, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Return a copy of the input string converted to lowercase.
 	 * @param src The string to convert.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 * @return The converted string.
 	 */
-	std::wstring to_lower_copy(const std::wstring& src);
+	std::wstring to_lower_copy(const std::wstring& src, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Convert the string to uppercase.
 	 * @param src The string to convert.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 */
-	void to_upper(std::string& src);
+	void to_upper(std::string& src, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Convert the string to uppercase.
 	 * @param src The string to convert.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 */
-	void to_upper(std::wstring& src);
+	void to_upper(std::wstring& src, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Convert the first string to uppercase and save to the second one.
 	 * @param src The string to convert.
 	 * @param dst The string to save the result.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 */
-	void to_upper(const std::string& src, std::string& dst);
+	void to_upper(const std::string& src, std::string& dst, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Convert the first string to uppercase and save to the second one.
 	 * @param src The string to convert.
 	 * @param dst The string to save the result.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 */
-	void to_upper(const std::wstring& src, std::wstring& dst);
+	void to_upper(const std::wstring& src, std::wstring& dst, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Return a copy of the input string converted to uppercase.
 	 * @param src The string to convert.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 * @return The converted string.
 	 */
-	std::string to_upper_copy(const std::string& src);
+	std::string to_upper_copy(const std::string& src, const CaseContext& ctx = CaseContext::global());
 
 	/**
 	 * @brief Return a copy of the input string converted to uppercase.
 	 * @param src The string to convert.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
 	 * @return The converted string.
 	 */
-	std::wstring to_upper_copy(const std::wstring& src);
+	std::wstring to_upper_copy(const std::wstring& src, const CaseContext& ctx = CaseContext::global());
 
 	/**
-	 * @brief Splits a string into a maximum number substrings based on the provided character separator.
-	 * @param s Input string.
-	 * @param sep Character separators.
-	 * @param strArray Container for saving substrings. 
-	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
-	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 * @brief Convert a UTF-8 string to lowercase using Unicode simple case mapping.
+	 *
+	 * Covers Latin-1, Latin Extended-A, Latin Extended Additional, Greek, Cyrillic, Armenian
+	 * and fullwidth Latin letters. Other code points and invalid byte sequences are kept as they are.
+	 * @param src The string to convert.
 	 */
-	void split(const std::string& s, const std::string& sep, std::vector<std::string>& strArray, bool excludeEmpty = false, bool trimStr = false);
+	void utf8_to_lower(std::string& src);
 
 	/**
-	 * @brief Splits a string into a maximum number substrings based on the provided character separator.
-	 * @param s Input string.
-	 * @param sep Character separators.
-	 * @param strArray Container for saving substrings.
-	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
-	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 * @brief Convert the first UTF-8 string to lowercase and save to the second one.
+	 * @param src The string to convert.
+	 * @param dst The string to save the result.
 	 */
-	void split(const std::wstring& s, const std::wstring& sep, std::vector<std::wstring>& strArray, bool excludeEmpty = false, bool trimStr = false);
+	void utf8_to_lower(const std::string& src, std::string& dst);
 
 	/**
-	 * @brief Splits a string into a maximum number substrings based on the provided character separator.
-	 * @param s Input string.
-	 * @param sep Character separators.
-	 * @param strArray Container for saving substrings.
-	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
-	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 * @brief Return a copy of the input UTF-8 string converted to lowercase.
+	 * @param src The string to convert.
+	 * @return The converted string.
 	 */
-	void split(const std::string& s, const std::string& sep, std::list<std::string>& strList, bool excludeEmpty = false, bool trimStr = false);
+	std::string utf8_to_lower_copy(const std::string& src);
 
 	/**
-	 * @brief Splits a string into a maximum number substrings based on the provided character separator.
-	 * @param s Input string.
-	 * @param sep Character separators.
-	 * @param strArray Container for saving substrings.
-	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
-	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 * @brief Convert a UTF-8 string to uppercase using Unicode simple case mapping.
+	 * @param src The string to convert.
 	 */
-	void split(const std::wstring& s, const std::wstring& sep, std::list<std::wstring>& strList, bool excludeEmpty = false, bool trimStr = false);
+	void utf8_to_upper(std::string& src);
+
+	/**
+	 * @brief Convert the first UTF-8 string to uppercase and save to the second one.
+	 * @param src The string to convert.
+	 * @param dst The string to save the result.
+	 */
+	void utf8_to_upper(const std::string& src, std::string& dst);
+
+	/**
+	 * @brief Return a copy of the input UTF-8 string converted to uppercase.
+	 * @param src The string to convert.
+	 * @return The converted string.
+	 */
+	std::string utf8_to_upper_copy(const std::string& src);
+
+	/**
+	 * @brief Convert a UTF-8 string to its simple case folded form, suitable for caseless matching.
+	 * @param src The string to convert.
+	 * @param dst The string to save the result.
+	 */
+	void utf8_fold_case(const std::string& src, std::string& dst);
+
+	/**
+	 * @brief Determines whether two UTF-8 strings have the same value.
+	 * @param src First string.
+	 * @param dst Second string.
+	 * @param ignoreCase true to compare the simple case folded code points; otherwise, false.
+	 * @return Whether the first string and the second string have the same value.
+	 */
+	bool utf8_equals(const std::string& src, const std::string& dst, bool ignoreCase = false);
+
+	/**
+	 * @brief Determines whether the first UTF-8 string starts with the second one.
+	 * @param src First string.
+	 * @param dst Second string.
+	 * @param ignoreCase true to compare the simple case folded code points; otherwise, false.
+	 * @return Whether the first string starts with the second string.
+	 */
+	bool utf8_starts_with(const std::string& src, const std::string& dst, bool ignoreCase = false);
+
+	/**
+	 * @brief Returns a value indicating whether the second UTF-8 string occurs within the first one.
+	 * @param src First string.
+	 * @param dst Second string.
+	 * @param ignoreCase true to compare the simple case folded code points; otherwise, false.
+	 * @return true if the second string occurs within the first string, or if it is empty; otherwise, false.
+	 */
+	bool utf8_contains(const std::string& src, const std::string& dst, bool ignoreCase = false);
+
+	/**
+	 * @brief Transcode UTF-8 to wide chars, UTF-32 or UTF-16 depending on the size of wchar_t.
+	 * @param src UTF-8 input.
+	 * @param srcLen Input length in bytes.
+	 * @param dst Output buffer, srcLen units are always enough.
+	 * @param dstLen Capacity of dst in units on input, number of units written on output.
+	 * @return false if the input is not valid UTF-8 or dst is too small; otherwise, true.
+	 */
+	bool utf8_to_wide(const char* src, size_t srcLen, wchar_t* dst, size_t& dstLen);
+
+	/**
+	 * @brief Transcode wide chars, UTF-32 or UTF-16 depending on the size of wchar_t, to UTF-8.
+	 * @param src Wide input.
+	 * @param srcLen Input length in units.
+	 * @param dst Output buffer, srcLen * 4 bytes (srcLen * 3 for UTF-16) are always enough.
+	 * @param dstLen Capacity of dst in bytes on input, number of bytes written on output.
+	 * @return false if the input has invalid code points or unpaired surrogates, or dst is too small; otherwise, true.
+	 */
+	bool wide_to_utf8(const wchar_t* src, size_t srcLen, char* dst, size_t& dstLen);
+
+	/**
+	 * @brief Transcode UTF-8 to UTF-16.
+	 * @param src UTF-8 input.
+	 * @param srcLen Input length in bytes.
+	 * @param dst Output buffer, srcLen units are always enough.
+	 * @param dstLen Capacity of dst in units on input, number of units written on output.
+	 * @return false if the input is not valid UTF-8 or dst is too small; otherwise, true.
+	 */
+	bool utf8_to_utf16(const char* src, size_t srcLen, char16_t* dst, size_t& dstLen);
+
+	/**
+	 * @brief Transcode UTF-16 to UTF-8.
+	 * @param src UTF-16 input.
+	 * @param srcLen Input length in units.
+	 * @param dst Output buffer, srcLen * 3 bytes are always enough.
+	 * @param dstLen Capacity of dst in bytes on input, number of bytes written on output.
+	 * @return false if the input has unpaired surrogates or dst is too small; otherwise, true.
+	 */
+	bool utf16_to_utf8(const char16_t* src, size_t srcLen, char* dst, size_t& dstLen);
+
+	/**
+	 * @brief Transcode a UTF-8 string to a wide string.
+	 * @param src UTF-8 input.
+	 * @param dst Wide output, cleared if the input is invalid.
+	 * @return false if the input is not valid UTF-8; otherwise, true.
+	 */
+	bool utf8_to_wide(const std::string& src, std::wstring& dst);
+
+	/**
+	 * @brief Transcode a wide string to a UTF-8 string.
+	 * @param src Wide input.
+	 * @param dst UTF-8 output, cleared if the input is invalid.
+	 * @return false if the input has invalid code points; otherwise, true.
+	 */
+	bool wide_to_utf8(const std::wstring& src, std::string& dst);
+
+	/**
+	 * @brief Splits a string into a maximum number substrings based on the provided character separator.
+	 * @param s Input string.
+	 * @param sep Character separators.
+	 * @param strArray Container for saving substrings. 
+	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 */
+	void split(const std::string& s, const std::string& sep, std::vector<std::string>& strArray, bool excludeEmpty = false, bool trimStr = false);
+
+	/**
+	 * @brief Splits a string into a maximum number substrings based on the provided character separator.
+	 * @param s Input string.
+	 * @param sep Character separators.
+	 * @param strArray Container for saving substrings.
+	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 */
+	void split(const std::wstring& s, const std::wstring& sep, std::vector<std::wstring>& strArray, bool excludeEmpty = false, bool trimStr = false);
+
+	/**
+	 * @brief Splits a string into a maximum number substrings based on the provided character separator.
+	 * @param s Input string.
+	 * @param sep Character separators.
+	 * @param strArray Container for saving substrings.
+	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 */
+	void split(const std::string& s, const std::string& sep, std::list<std::string>& strList, bool excludeEmpty = false, bool trimStr = false);
+
+	/**
+	 * @brief Splits a string into a maximum number substrings based on the provided character separator.
+	 * @param s Input string.
+	 * @param sep Character separators.
+	 * @param strArray Container for saving substrings.
+	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 */
+	void split(const std::wstring& s, const std::wstring& sep, std::list<std::wstring>& strList, bool excludeEmpty = false, bool trimStr = false);
+
+	/**
+	 * @brief String of up to N characters stored inline, moving to the heap only when longer.
+	 *
+	 * A std::vector of InlineString keeps short tokens inside its own contiguous block, with
+	 * no allocation per token. The characters are always followed by a terminating zero.
+	 */
+	template<size_t N>
+	class InlineString {
+	public:
+		typedef char value_type;
+		typedef char* iterator;
+		typedef const char* const_iterator;
+		static const size_t npos = (size_t)-1;
+
+		InlineString() : _Size(0), _OnHeap(false) { _Storage.chars[0] = '\0'; }
+		InlineString(const char* s) : _Size(0), _OnHeap(false) { _Storage.chars[0] = '\0'; assign(s, std::char_traits<char>::length(s)); }
+		InlineString(const char* s, size_t n) : _Size(0), _OnHeap(false) { _Storage.chars[0] = '\0'; assign(s, n); }
+		InlineString(const std::string& s) : _Size(0), _OnHeap(false) { _Storage.chars[0] = '\0'; assign(s.data(), s.size()); }
+		InlineString(string_view s) : _Size(0), _OnHeap(false) { _Storage.chars[0] = '\0'; assign(s.data(), s.size()); }
+		InlineString(const InlineString& other) : _Size(0), _OnHeap(false) { _Storage.chars[0] = '\0'; assign(other.data(), other.size()); }
+		InlineString(InlineString&& other) noexcept : _Size(0), _OnHeap(false) { take(other); }
+		~InlineString() { release(); }
+
+		InlineString& operator=(const InlineString& other) {
+			if (this != &other) assign(other.data(), other.size());
+			return *this;
+		}
+
+		InlineString& operator=(InlineString&& other) noexcept {
+			if (this != &other) {
+				release();
+				take(other);
+			}
+			return *this;
+		}
+
+		InlineString& operator=(string_view s) { return assign(s.data(), s.size()); }
+
+		const char* data() const { return _OnHeap ? _Storage.heap.data : _Storage.chars; }
+		char* data() { return _OnHeap ? _Storage.heap.data : _Storage.chars; }
+		const char* c_str() const { return data(); }
+		size_t size() const { return _Size; }
+		size_t length() const { return _Size; }
+		bool empty() const { return _Size == 0; }
+
+		/** @brief Characters that fit without reallocating; N while the string is inline. */
+		size_t capacity() const { return _OnHeap ? _Storage.heap.capacity : N; }
+
+		/** @brief Whether the characters are stored inside the object. */
+		bool is_inline() const { return !_OnHeap; }
+
+		char& operator[](size_t i) { return data()[i]; }
+		const char& operator[](size_t i) const { return data()[i]; }
+		iterator begin() { return data(); }
+		iterator end() { return data() + _Size; }
+		const_iterator begin() const { return data(); }
+		const_iterator end() const { return data() + _Size; }
+
+		operator string_view() const { return string_view(data(), _Size); }
+		std::string str() const { return std::string(data(), _Size); }
+
+		/**
+		 * @brief Replace the content; s may point into this string.
+		 * @param s Characters to copy.
+		 * @param n Number of characters.
+		 * @return This string.
+		 */
+		InlineString& assign(const char* s, size_t n) {
+			if (n > capacity()) {
+				char* block = new char[n + 1];
+				std::char_traits<char>::copy(block, s, n);
+				adopt(block, n);
+			}
+			else {
+				std::char_traits<char>::move(data(), s, n);
+			}
+			_Size = n;
+			data()[n] = '\0';
+			return *this;
+		}
+
+		/**
+		 * @brief Append characters, growing the heap block geometrically; s may point into this string.
+		 * @param s Characters to append.
+		 * @param n Number of characters.
+		 * @return This string.
+		 */
+		InlineString& append(const char* s, size_t n) {
+			if (_Size + n > capacity()) {
+				size_t cap = std::max(_Size + n, capacity() * 2);
+				char* block = new char[cap + 1];
+				std::char_traits<char>::copy(block, data(), _Size);
+				std::char_traits<char>::copy(block + _Size, s, n);
+				adopt(block, cap);
+			}
+			else {
+				std::char_traits<char>::move(data() + _Size, s, n);
+			}
+			_Size += n;
+			data()[_Size] = '\0';
+			return *this;
+		}
+
+		InlineString& append(string_view s) { return append(s.data(), s.size()); }
+		void push_back(char c) { append(&c, 1); }
+
+		/** @brief Empty the string, keeping any heap block for reuse. */
+		void clear() {
+			_Size = 0;
+			data()[0] = '\0';
+		}
+
+		void resize(size_t n, char c = '\0') {
+			if (n <= _Size) {
+				_Size = n;
+				data()[n] = '\0';
+				return;
+			}
+			while (_Size < n) push_back(c);
+		}
+
+		int compare(string_view s) const { return string_view(*this).compare(s); }
+
+		friend bool operator==(const InlineString& a, const InlineString& b) { return string_view(a) == string_view(b); }
+		friend bool operator!=(const InlineString& a, const InlineString& b) { return !(a == b); }
+		friend bool operator<(const InlineString& a, const InlineString& b) { return string_view(a) < string_view(b); }
+		friend bool operator==(const InlineString& a, string_view b) { return string_view(a) == b; }
+		friend bool operator!=(const InlineString& a, string_view b) { return !(a == b); }
+		friend bool operator==(const InlineString& a, const char* b) { return string_view(a) == string_view(b); }
+		friend bool operator!=(const InlineString& a, const char* b) { return !(a == b); }
+		friend bool operator==(const InlineString& a, const std::string& b) { return string_view(a) == string_view(b); }
+		friend bool operator!=(const InlineString& a, const std::string& b) { return !(a == b); }
+
+	private:
+		struct HeapBlock {
+			char* data;
+			size_t capacity;
+		};
+
+		union Storage {
+			char chars[N + 1];
+			HeapBlock heap;
+		};
+
+		void release() {
+			if (_OnHeap) delete[] _Storage.heap.data;
+			_OnHeap = false;
+		}
+
+		// Switch to block, which already holds the wanted characters.
+		void adopt(char* block, size_t capacity) {
+			release();
+			_Storage.heap.data = block;
+			_Storage.heap.capacity = capacity;
+			_OnHeap = true;
+		}
+
+		// Move other's characters here and leave it empty; this string holds no heap block.
+		void take(InlineString& other) {
+			_Size = other._Size;
+			_OnHeap = other._OnHeap;
+			if (_OnHeap) _Storage.heap = other._Storage.heap;
+			else std::char_traits<char>::copy(_Storage.chars, other._Storage.chars, _Size + 1);
+			other._Size = 0;
+			other._OnHeap = false;
+			other._Storage.chars[0] = '\0';
+		}
+
+		size_t _Size;
+		bool _OnHeap;
+		Storage _Storage;
+	};
+
+	template<size_t N>
+	const size_t InlineString<N>::npos;
+
+	/**
+	 * @brief Splits a string into inline strings, so short substrings need no allocation of their own.
+	 * @param s Input string.
+	 * @param sep Character separators.
+	 * @param strArray Container for saving substrings.
+	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 */
+	template<size_t N>
+	inline void split(const std::string& s, const std::string& sep, std::vector<InlineString<N> >& strArray, bool excludeEmpty = false, bool trimStr = false) {
+		unsigned long long isSep[4] = { 0, 0, 0, 0 };
+		for (size_t i = 0; i < sep.size(); i++)
+			isSep[(unsigned char)sep[i] >> 6] |= 1ULL << ((unsigned char)sep[i] & 63);
+
+		strArray.clear();
+		if (s.empty()) return;
+
+		const char* end = s.data() + s.size();
+		for (const char* p = s.data();; ) {
+			const char* q = p;
+			while (q < end && !((isSep[(unsigned char)*q >> 6] >> ((unsigned char)*q & 63)) & 1)) q++;
+			if (!excludeEmpty || q != p) {
+				const char* first = p;
+				const char* last = q;
+				if (trimStr) {
+					while (first < last && SpaceChars::contains(*first)) first++;
+					while (last > first && SpaceChars::contains(last[-1])) last--;
+				}
+				strArray.emplace_back(first, (size_t)(last - first));
+			}
+			if (q == end) break;
+			p = q + 1;
+		}
+	}
+
+	/**
+	 * @brief Splits a string into at most maxParts substrings; the last one holds the unsplit remainder.
+	 *
+	 * Scanning stops as soon as maxParts - 1 substrings have been found.
+	 * @param s Input string.
+	 * @param sep Character separators.
+	 * @param maxParts Maximum number of substrings, 0 for no limit.
+	 * @param strArray Container for saving substrings.
+	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 */
+	void split_n(const std::string& s, const std::string& sep, size_t maxParts, std::vector<std::string>& strArray, bool excludeEmpty = false, bool trimStr = false);
+
+	/**
+	 * @brief Splits a string into at most maxParts substrings; the last one holds the unsplit remainder.
+	 *
+	 * Scanning stops as soon as maxParts - 1 substrings have been found.
+	 * @param s Input string.
+	 * @param sep Character separators.
+	 * @param maxParts Maximum number of substrings, 0 for no limit.
+	 * @param strArray Container for saving substrings.
+	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 */
+	void split_n(const std::wstring& s, const std::wstring& sep, size_t maxParts, std::vector<std::wstring>& strArray, bool excludeEmpty = false, bool trimStr = false);
+
+	/**
+	 * @brief Gets the substring at an index, as split() would produce it, scanning no further than needed.
+	 * @param s Input string.
+	 * @param sep Character separators.
+	 * @param index Index of the substring, starting from 0.
+	 * @param field Saves the substring if it exists.
+	 * @param excludeEmpty Empty substrings are not counted if true.
+	 * @param trimStr The substring will be trimmed if true.
+	 * @return true if the substring exists; otherwise, false.
+	 */
+	bool field_at(const std::string& s, const std::string& sep, size_t index, std::string& field, bool excludeEmpty = false, bool trimStr = false);
+
+	/**
+	 * @brief Gets the substring at an index, as split() would produce it, scanning no further than needed.
+	 * @param s Input string.
+	 * @param sep Character separators.
+	 * @param index Index of the substring, starting from 0.
+	 * @param field Saves the substring if it exists.
+	 * @param excludeEmpty Empty substrings are not counted if true.
+	 * @param trimStr The substring will be trimmed if true.
+	 * @return true if the substring exists; otherwise, false.
+	 */
+	bool field_at(const std::wstring& s, const std::wstring& sep, size_t index, std::wstring& field, bool excludeEmpty = false, bool trimStr = false);
+
+	/**
+	 * @brief Splits a string of numbers and converts every substring in the same pass.
+	 *
+	 * Supported types are int, long, long long, their unsigned variants, float and double.
+	 * Substrings are trimmed before conversion. Decimal numbers use '.' as the decimal point,
+	 * and inputs that cannot be rounded exactly by the fast path are converted with strtod/strtof.
+	 * @param s Input string.
+	 * @param sep Character separators.
+	 * @param values Saves one value per substring, 0 for substrings which failed to convert.
+	 * @param badFields Saves the indexes of the substrings which failed to convert, if not NULL.
+	 * @param excludeEmpty Empty substrings would be skipped if true, otherwise they fail to convert.
+	 * @return Number of substrings which failed to convert.
+	 */
+	template<typename T>
+	size_t split_parse(const std::string& s, const std::string& sep, std::vector<T>& values, std::vector<size_t>* badFields = NULL, bool excludeEmpty = false);
+
+	/**
+	 * @brief Thread-safe pool of unique strings, each stored once and identified by a 32-bit id.
+	 *
+	 * Strings are copied into arena blocks that never move, so the returned views stay valid for
+	 * the lifetime of the pool. Lookups never lock: find(), view(), size() and intern() of a string
+	 * already in the pool only read atomically published entries. Adding a new string locks the
+	 * mutex of one of the shards the pool is split into, so threads adding different strings
+	 * rarely wait on each other.
+	 */
+	class InternPool {
+	public:
+		/** @brief Id returned when a shard is full. */
+		static const unsigned int invalid_id = 0xFFFFFFFF;
+
+		/**
+		 * @brief Create an empty pool.
+		 * @param shardCount Number of shards, rounded up to a power of two, at most 256.
+		 */
+		explicit InternPool(size_t shardCount = 16);
+		~InternPool();
+
+		/**
+		 * @brief Add a string if it is not in the pool yet.
+		 * @param data String data.
+		 * @param len String length.
+		 * @return Id of the string.
+		 */
+		unsigned int intern(const char* data, size_t len);
+
+		/**
+		 * @brief Add a string if it is not in the pool yet.
+		 * @param s The string.
+		 * @return Id of the string.
+		 */
+		unsigned int intern(const std::string& s);
+
+		/**
+		 * @brief Add a string if it is not in the pool yet.
+		 * @param s The string.
+		 * @return View of the pooled copy.
+		 */
+		string_view intern_view(string_view s);
+
+		/**
+		 * @brief Look a string up without adding it.
+		 * @param s The string.
+		 * @param id Saves the id of the string if found.
+		 * @return true if the string is in the pool; otherwise, false.
+		 */
+		bool find(string_view s, unsigned int& id) const;
+
+		/**
+		 * @brief Get the pooled string of an id.
+		 * @param id Id returned by intern().
+		 * @return View of the pooled string, empty for unknown ids.
+		 */
+		string_view view(unsigned int id) const;
+
+		/**
+		 * @brief Number of unique strings in the pool.
+		 */
+		size_t size() const;
+
+	private:
+		InternPool(const InternPool&);
+		InternPool& operator=(const InternPool&);
+
+		struct Shard;
+		std::vector<Shard*> _Shards;
+		unsigned int _ShardBits;
+	};
+
+	/**
+	 * @brief Splits a string and interns every substring, saving ids instead of strings.
+	 * @param s Input string.
+	 * @param sep Character separators.
+	 * @param pool Pool to intern the substrings into.
+	 * @param ids Container for saving the ids of the substrings.
+	 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+	 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+	 */
+	void split(const std::string& s, const std::string& sep, InternPool& pool, std::vector<unsigned int>& ids, bool excludeEmpty = false, bool trimStr = false);
+
+	/** @brief A distinct token and the number of times it occurs. */
+	struct TokenCount {
+		TokenCount() : count(0) {}
+		TokenCount(string_view token, size_t count) : token(token), count(count) {}
+
+		string_view token;	// the first occurrence in the counted buffer
+		size_t count;
+	};
+
+	/**
+	 * @brief Count the occurrences of every token, like split() into a map, without copying token bytes.
+	 *
+	 * Each thread counts a part of the buffer in its own open-addressing table, and the tables are
+	 * merged at the end. Empty tokens are not counted. The views point into buffer, at the first
+	 * occurrence of each token, so the buffer must outlive the results.
+	 * @param buffer Input text.
+	 * @param sep Character separators.
+	 * @param counts Receives the tokens by descending count, ties in order of first occurrence.
+	 * @param ignoreCase true to count tokens that differ only in case as one token; otherwise, false.
+	 * @param threads Maximum number of threads for large buffers, 0 for one per hardware thread.
+	 * @param topK Keep only this many of the most frequent tokens, 0 to keep all.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 */
+	void count_tokens(string_view buffer, const std::string& sep, std::vector<TokenCount>& counts, bool ignoreCase = false, size_t threads = 1, size_t topK = 0, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Streaming CSV tokenizer that honours quoted fields.
+	 *
+	 * Input is fed in chunks of any size; records may straddle chunks. Separators and line
+	 * ends inside double-quoted fields are part of the field, and doubled quotes inside a
+	 * quoted field stand for one quote. Fields are returned as views which stay valid until
+	 * the next call to feed(), next() or reset(); only fields with doubled quotes are copied.
+	 */
+	class CsvReader {
+	public:
+		/**
+		 * @brief Create a reader.
+		 * @param sep Field separator.
+		 * @param quote Quote character.
+		 */
+		explicit CsvReader(char sep = ',', char quote = '"');
+
+		/**
+		 * @brief Append a chunk of input.
+		 * @param data Chunk data.
+		 * @param len Chunk length.
+		 */
+		void feed(const char* data, size_t len);
+
+		/**
+		 * @brief Mark the end of input, so a last record without a line end can be read.
+		 */
+		void finish();
+
+		/**
+		 * @brief Read the next complete record.
+		 * @param fields Fields of the record, "\r\n" and "\n" line ends are not included.
+		 * @return true if a record was read, false if more input is needed or the input is exhausted.
+		 */
+		bool next(std::vector<string_view>& fields);
+
+		/**
+		 * @brief Discard all buffered input and state.
+		 */
+		void reset();
+
+	private:
+		bool scan(size_t& recEnd);
+
+		char _Sep;
+		char _Quote;
+		std::string _Buf;
+		std::string _Scratch;
+		std::vector<size_t> _FieldEnds;
+		size_t _RecStart;
+		size_t _ScanPos;
+		bool _InQuote;
+		bool _Finished;
+	};
+
+	/**
+	 * @brief Index of the separator positions of a delimited buffer, for random field access.
+	 *
+	 * Built in one pass over one line or many; afterwards any field is found with two lookups.
+	 * The indexed buffer is not copied and must outlive the index.
+	 */
+	class FieldIndex {
+	public:
+		/**
+		 * @brief Create an empty index.
+		 */
+		FieldIndex();
+
+		/**
+		 * @brief Index a buffer.
+		 * @param data Buffer to index.
+		 * @param len Buffer length.
+		 * @param sep Field separator.
+		 * @param eol Row separator; a "\r" before a "\n" row separator is not part of the last field.
+		 */
+		FieldIndex(const char* data, size_t len, char sep, char eol = '\n');
+
+		/**
+		 * @brief Index a buffer, replacing the previous index.
+		 * @param data Buffer to index.
+		 * @param len Buffer length.
+		 * @param sep Field separator.
+		 * @param eol Row separator; a "\r" before a "\n" row separator is not part of the last field.
+		 */
+		void build(const char* data, size_t len, char sep, char eol = '\n');
+
+		/**
+		 * @brief Number of rows; a trailing row separator does not start a new row.
+		 */
+		size_t row_count() const;
+
+		/**
+		 * @brief Number of fields of a row.
+		 * @param row Row number, starting from 0.
+		 * @return Number of fields, 0 if the row does not exist.
+		 */
+		size_t field_count(size_t row) const;
+
+		/**
+		 * @brief Get a field.
+		 * @param row Row number, starting from 0.
+		 * @param col Field number within the row, starting from 0.
+		 * @param trimStr The field will be trimmed if true.
+		 * @return View of the field, empty if it does not exist.
+		 */
+		string_view field(size_t row, size_t col, bool trimStr = false) const;
+
+	private:
+		const char* _Data;
+		char _Eol;
+		std::vector<size_t> _Ends;
+		std::vector<size_t> _RowFirst;
+	};
+
+	/**
+	 * @brief Reads a file ahead on a background thread and hands out whole lines.
+	 *
+	 * The reader thread fills a ring of buffers while the caller tokenizes earlier ones. Each
+	 * chunk ends after its last line end; the partial line is carried into the next buffer by
+	 * the reader thread, so every line is contiguous. Views stay valid until the next call.
+	 */
+	class AsyncLineSource {
+	public:
+		/**
+		 * @brief Create a closed source.
+		 * @param bufferSize Bytes read per request.
+		 * @param bufferCount Number of buffers in the ring, at least 2.
+		 */
+		explicit AsyncLineSource(size_t bufferSize = 1 << 20, size_t bufferCount = 4);
+		~AsyncLineSource();
+
+		/**
+		 * @brief Open a file and start reading ahead.
+		 * @param path File path.
+		 * @return true if the file was opened; otherwise, false.
+		 */
+		bool open(const std::string& path);
+
+		/**
+		 * @brief Start reading ahead from an open stream, which is not closed by this source.
+		 * @param file The stream.
+		 * @return true if started; otherwise, false.
+		 */
+		bool attach(FILE* file);
+
+		/**
+		 * @brief Stop the reader thread and close the file.
+		 */
+		void close();
+
+		/**
+		 * @brief Get the next chunk of whole lines; the last chunk may lack a final line end.
+		 * @param chunk Saves the chunk, including its line ends.
+		 * @return true if a chunk was read, false at the end of input.
+		 */
+		bool next_chunk(string_view& chunk);
+
+		/**
+		 * @brief Get the next line.
+		 * @param line Saves the line, "\r\n" and "\n" line ends are not included.
+		 * @return true if a line was read, false at the end of input.
+		 */
+		bool next_line(string_view& line);
+
+		/**
+		 * @brief Get the next line split into fields.
+		 * @param sep Character separators.
+		 * @param fields Saves the fields of the line.
+		 * @param excludeEmpty Empty fields would be removed if true, otherwise empty fields are included.
+		 * @param trimStr Every field will be trimmed if true, otherwise fields will keep as they are.
+		 * @return true if a line was read, false at the end of input.
+		 */
+		bool next_fields(const std::string& sep, std::vector<string_view>& fields, bool excludeEmpty = false, bool trimStr = false);
+
+		/**
+		 * @brief Whether reading failed; input before the failure is still delivered.
+		 */
+		bool error() const;
+
+	private:
+		AsyncLineSource(const AsyncLineSource&);
+		AsyncLineSource& operator=(const AsyncLineSource&);
+
+		bool start(FILE* file, bool owned);
+
+		struct State;
+		State* _State;
+		size_t _BufferSize;
+		size_t _BufferCount;
+	};
+
+	/**
+	 * @brief Runs a chain of string operations over a stream of lines on a pool of worker threads.
+	 *
+	 * Lines pushed by one producer are grouped into batches; each worker takes a batch and applies
+	 * every stage to it, so stages are fused and a batch never waits between them. Batches pass
+	 * through bounded lock-free queues, and at most five batches per worker are between push() and
+	 * next_batch(): push() blocks when the workers or the consumer fall behind, also while an early
+	 * batch holds back ordered delivery. Idle threads sleep instead of polling. Stages must be added
+	 * before the first push().
+	 */
+	class Pipeline {
+	public:
+		/**
+		 * @brief Create an empty pipeline.
+		 * @param threads Number of worker threads, 0 for one per hardware thread.
+		 * @param ordered true to deliver results in input order; otherwise, in completion order.
+		 * @param batchSize Number of input lines per batch.
+		 */
+		explicit Pipeline(size_t threads = 0, bool ordered = true, size_t batchSize = 1024);
+		~Pipeline();
+
+		/**
+		 * @brief Add a stage replacing every line by its substrings, like split().
+		 * @param sep Character separators.
+		 * @param excludeEmpty Empty substrings would be removed if true, otherwise empty substrings are included.
+		 * @param trimStr Every substring will be trimmed if true, otherwise substrings will keep as they are.
+		 * @return This pipeline.
+		 */
+		Pipeline& split(const std::string& sep, bool excludeEmpty = false, bool trimStr = false);
+
+		/**
+		 * @brief Add a stage trimming every line.
+		 * @return This pipeline.
+		 */
+		Pipeline& trim();
+
+		/**
+		 * @brief Add a stage trimming every line and collapsing its white-space runs.
+		 * @return This pipeline.
+		 */
+		Pipeline& normalize_space();
+
+		/**
+		 * @brief Add a stage converting every line to lowercase.
+		 * @param ctx Case conversion context, the shared context of the global locale by default.
+		 * @return This pipeline.
+		 */
+		Pipeline& to_lower(const CaseContext& ctx = CaseContext::global());
+
+		/**
+		 * @brief Add a stage converting every line to uppercase.
+		 * @param ctx Case conversion context, the shared context of the global locale by default.
+		 * @return This pipeline.
+		 */
+		Pipeline& to_upper(const CaseContext& ctx = CaseContext::global());
+
+		/**
+		 * @brief Add a stage keeping only the lines that contain the needle.
+		 * @param needle The string to search for.
+		 * @param ignoreCase true to ignore case when matching; otherwise, false.
+		 * @param ctx Case conversion context, the shared context of the global locale by default.
+		 * @return This pipeline.
+		 */
+		Pipeline& filter_contains(const std::string& needle, bool ignoreCase = false, const CaseContext& ctx = CaseContext::global());
+
+		/**
+		 * @brief Add a stage modifying every line with a function, which may run on several threads at once.
+		 * @param fn The function.
+		 * @return This pipeline.
+		 */
+		Pipeline& map(const std::function<void(std::string&)>& fn);
+
+		/**
+		 * @brief Add a stage keeping only the lines the predicate accepts, which may run on several threads at once.
+		 * @param fn The predicate.
+		 * @return This pipeline.
+		 */
+		Pipeline& filter(const std::function<bool(const std::string&)>& fn);
+
+		/**
+		 * @brief Feed a line, starting the workers on first use; blocks while too many batches are undelivered.
+		 * @param line The line.
+		 */
+		void push(string_view line);
+
+		/**
+		 * @brief Mark the end of input, further lines are ignored.
+		 */
+		void close();
+
+		/**
+		 * @brief Wait for the next batch of results, from any thread but one at a time.
+		 * @param results Saves the results of one input batch.
+		 * @return true if a batch was read, false once every result was delivered after close().
+		 */
+		bool next_batch(std::vector<std::string>& results);
+
+		/**
+		 * @brief Process all lines, feeding them from a helper thread while collecting the results.
+		 * @param lines Input lines.
+		 * @param results Saves the results.
+		 */
+		void run(const std::vector<std::string>& lines, std::vector<std::string>& results);
+
+	private:
+		Pipeline(const Pipeline&);
+		Pipeline& operator=(const Pipeline&);
+
+		struct State;
+		State* _State;
+	};
+
+	/**
+	 * @brief Concatenates the strings of the array, using the separator between each of them.
+	 * @param strArray Strings to concatenate.
+	 * @param sep Separator.
+	 * @return The joined string, allocated once.
+	 */
+	std::string join(const std::vector<std::string>& strArray, const std::string& sep);
+
+	/**
+	 * @brief Concatenates the strings of the array, using the separator between each of them.
+	 * @param strArray Strings to concatenate.
+	 * @param sep Separator.
+	 * @return The joined string, allocated once.
+	 */
+	std::wstring join(const std::vector<std::wstring>& strArray, const std::wstring& sep);
+
+	/**
+	 * @brief Concatenates the strings of the list, using the separator between each of them.
+	 * @param strList Strings to concatenate.
+	 * @param sep Separator.
+	 * @return The joined string, allocated once.
+	 */
+	std::string join(const std::list<std::string>& strList, const std::string& sep);
+
+	/**
+	 * @brief Concatenates the strings of the list, using the separator between each of them.
+	 * @param strList Strings to concatenate.
+	 * @param sep Separator.
+	 * @return The joined string, allocated once.
+	 */
+	std::wstring join(const std::list<std::wstring>& strList, const std::wstring& sep);
+
+	/**
+	 * @brief Concatenates the viewed strings, using the separator between each of them.
+	 * @param strArray Strings to concatenate.
+	 * @param sep Separator.
+	 * @return The joined string, allocated once.
+	 */
+	std::string join(const std::vector<string_view>& strArray, const std::string& sep);
+
+	/**
+	 * @brief Concatenates the viewed strings, using the separator between each of them.
+	 * @param strArray Strings to concatenate.
+	 * @param sep Separator.
+	 * @return The joined string, allocated once.
+	 */
+	std::wstring join(const std::vector<wstring_view>& strArray, const std::wstring& sep);
+
+	/**
+	 * @brief Appends the strings of the array to dst, using the separator between each of them.
+	 * @param dst String to append to, grown once.
+	 * @param strArray Strings to concatenate.
+	 * @param sep Separator.
+	 * @param threads Maximum number of threads copying disjoint parts of large results, 0 for one per hardware thread.
+	 */
+	void join_into(std::string& dst, const std::vector<std::string>& strArray, const std::string& sep, size_t threads = 1);
+
+	/**
+	 * @brief Appends the strings of the array to dst, using the separator between each of them.
+	 * @param dst String to append to, grown once.
+	 * @param strArray Strings to concatenate.
+	 * @param sep Separator.
+	 * @param threads Maximum number of threads copying disjoint parts of large results, 0 for one per hardware thread.
+	 */
+	void join_into(std::wstring& dst, const std::vector<std::wstring>& strArray, const std::wstring& sep, size_t threads = 1);
+
+	/**
+	 * @brief Appends the strings of the list to dst, using the separator between each of them.
+	 * @param dst String to append to, grown once.
+	 * @param strList Strings to concatenate.
+	 * @param sep Separator.
+	 */
+	void join_into(std::string& dst, const std::list<std::string>& strList, const std::string& sep);
+
+	/**
+	 * @brief Appends the strings of the list to dst, using the separator between each of them.
+	 * @param dst String to append to, grown once.
+	 * @param strList Strings to concatenate.
+	 * @param sep Separator.
+	 */
+	void join_into(std::wstring& dst, const std::list<std::wstring>& strList, const std::wstring& sep);
+
+	/**
+	 * @brief Appends the viewed strings to dst, using the separator between each of them.
+	 * @param dst String to append to, grown once.
+	 * @param strArray Strings to concatenate.
+	 * @param sep Separator.
+	 * @param threads Maximum number of threads copying disjoint parts of large results, 0 for one per hardware thread.
+	 */
+	void join_into(std::string& dst, const std::vector<string_view>& strArray, const std::string& sep, size_t threads = 1);
+
+	/**
+	 * @brief Appends the viewed strings to dst, using the separator between each of them.
+	 * @param dst String to append to, grown once.
+	 * @param strArray Strings to concatenate.
+	 * @param sep Separator.
+	 * @param threads Maximum number of threads copying disjoint parts of large results, 0 for one per hardware thread.
+	 */
+	void join_into(std::wstring& dst, const std::vector<wstring_view>& strArray, const std::wstring& sep, size_t threads = 1);
+
+	/**
+	 * @brief Trim every string of the array.
+	 * @param strArray Strings for trimming.
+	 * @param threads Maximum number of threads for large arrays, 0 for one per hardware thread.
+	 */
+	void trim_all(std::vector<std::string>& strArray, size_t threads = 1);
+
+	/**
+	 * @brief Trim every string of the array.
+	 * @param strArray Strings for trimming.
+	 * @param threads Maximum number of threads for large arrays, 0 for one per hardware thread.
+	 */
+	void trim_all(std::vector<std::wstring>& strArray, size_t threads = 1);
+
+	/**
+	 * @brief Convert every string of the array to lowercase.
+	 * @param strArray Strings to convert.
+	 * @param threads Maximum number of threads for large arrays, 0 for one per hardware thread.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 */
+	void to_lower_all(std::vector<std::string>& strArray, size_t threads = 1, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Convert every string of the array to lowercase.
+	 * @param strArray Strings to convert.
+	 * @param threads Maximum number of threads for large arrays, 0 for one per hardware thread.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 */
+	void to_lower_all(std::vector<std::wstring>& strArray, size_t threads = 1, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Convert every string of the array to uppercase.
+	 * @param strArray Strings to convert.
+	 * @param threads Maximum number of threads for large arrays, 0 for one per hardware thread.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 */
+	void to_upper_all(std::vector<std::string>& strArray, size_t threads = 1, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Convert every string of the array to uppercase.
+	 * @param strArray Strings to convert.
+	 * @param threads Maximum number of threads for large arrays, 0 for one per hardware thread.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 */
+	void to_upper_all(std::vector<std::wstring>& strArray, size_t threads = 1, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Returns a value indicating whether the needle occurs within any string of the array.
+	 * @param strArray Strings to search.
+	 * @param needle String to seek.
+	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param threads Maximum number of threads for large arrays, 0 for one per hardware thread.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return true if any string contains the needle; otherwise, false.
+	 */
+	bool contains_any_of(const std::vector<std::string>& strArray, const std::string& needle, bool ignoreCase = false, size_t threads = 1, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Returns a value indicating whether the needle occurs within any string of the array.
+	 * @param strArray Strings to search.
+	 * @param needle String to seek.
+	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param threads Maximum number of threads for large arrays, 0 for one per hardware thread.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 * @return true if any string contains the needle; otherwise, false.
+	 */
+	bool contains_any_of(const std::vector<std::wstring>& strArray, const std::wstring& needle, bool ignoreCase = false, size_t threads = 1, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Sort the strings in compare() order, faster than std::sort on large arrays.
+	 * @param strArray Strings to sort.
+	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param threads Maximum number of threads for large arrays, 0 for one per hardware thread.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 */
+	void sort_strings(std::vector<std::string>& strArray, bool ignoreCase = false, size_t threads = 1, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Sort the strings in compare() order, faster than std::sort on large arrays.
+	 * @param strArray Strings to sort.
+	 * @param ignoreCase true to ignore case during the comparison; otherwise, false.
+	 * @param threads Maximum number of threads for large arrays, 0 for one per hardware thread.
+	 * @param ctx Case conversion context, the shared context of the global locale by default.
+	 */
+	void sort_strings(std::vector<std::wstring>& strArray, bool ignoreCase = false, size_t threads = 1, const CaseContext& ctx = CaseContext::global());
+
+	/**
+	 * @brief Write the decimal digits of an integer to a buffer, followed by a terminating zero.
+	 * @param buffer Buffer with room for at least 21 characters.
+	 * @param value The integer.
+	 * @return Pointer to the terminating zero.
+	 */
+	char* append_int(char* buffer, long long value);
+
+	/**
+	 * @brief Append the decimal digits of an integer.
+	 * @param dst String to append to.
+	 * @param value The integer.
+	 */
+	void append_int(std::string& dst, long long value);
+
+	/**
+	 * @brief Write the decimal digits of an unsigned integer to a buffer, followed by a terminating zero.
+	 * @param buffer Buffer with room for at least 21 characters.
+	 * @param value The integer.
+	 * @return Pointer to the terminating zero.
+	 */
+	char* append_uint(char* buffer, unsigned long long value);
+
+	/**
+	 * @brief Append the decimal digits of an unsigned integer.
+	 * @param dst String to append to.
+	 * @param value The integer.
+	 */
+	void append_uint(std::string& dst, unsigned long long value);
+
+	/**
+	 * @brief Write an integer in hexadecimal without prefix or leading zeros, followed by a terminating zero.
+	 * @param buffer Buffer with room for at least 17 characters.
+	 * @param value The integer.
+	 * @param upperCase true for the digits A-F; otherwise a-f.
+	 * @return Pointer to the terminating zero.
+	 */
+	char* append_hex(char* buffer, unsigned long long value, bool upperCase = false);
+
+	/**
+	 * @brief Append an integer in hexadecimal without prefix or leading zeros.
+	 * @param dst String to append to.
+	 * @param value The integer.
+	 * @param upperCase true for the digits A-F; otherwise a-f.
+	 */
+	void append_hex(std::string& dst, unsigned long long value, bool upperCase = false);
+
+	/**
+	 * @brief Write text that reads back as the same double, followed by a terminating zero.
+	 *
+	 * The digits come from Grisu2: they always read back exactly and are the shortest possible for
+	 * all but about 0.1% of values. Decimal exponents from -4 to 16 print in fixed notation
+	 * (0.001, 1.5, 100), others like 1.5e+20. The decimal point is always '.'; infinities and NaN
+	 * print as inf, -inf and nan.
+	 * @param buffer Buffer with room for at least 25 characters.
+	 * @param value The double.
+	 * @return Pointer to the terminating zero.
+	 */
+	char* append_double(char* buffer, double value);
+
+	/**
+	 * @brief Append text that reads back as the same double.
+	 *
+	 * The digits come from Grisu2: they always read back exactly and are the shortest possible for
+	 * all but about 0.1% of values. Decimal exponents from -4 to 16 print in fixed notation
+	 * (0.001, 1.5, 100), others like 1.5e+20. The decimal point is always '.'; infinities and NaN
+	 * print as inf, -inf and nan.
+	 * @param dst String to append to.
+	 * @param value The double.
+	 */
+	void append_double(std::string& dst, double value);
+
+	/**
+	 * @brief Append a string escaped for use inside a JSON string literal, without the quotes.
+	 *
+	 * Quotes, backslashes and control characters are escaped; other bytes, UTF-8 included, are
+	 * copied as they are. Runs without such characters are found 32 bytes at a time.
+	 * @param dst String to append to.
+	 * @param s The string.
+	 */
+	void append_json_escaped(std::string& dst, string_view s);
+
+	/**
+	 * @brief Write a string escaped for use inside a JSON string literal, followed by a terminating zero.
+	 * @param buffer Buffer with room for 6 characters per input character, plus one.
+	 * @param s The string.
+	 * @return Pointer to the terminating zero.
+	 */
+	char* append_json_escaped(char* buffer, string_view s);
+
+	/**
+	 * @brief Append a string as one CSV field, in double quotes with quotes doubled if it holds sep, a quote or a line break.
+	 * @param dst String to append to.
+	 * @param s The field.
+	 * @param sep Field separator.
+	 */
+	void append_csv_quoted(std::string& dst, string_view s, char sep = ',');
+
+	/**
+	 * @brief Write a string as one CSV field, followed by a terminating zero; see append_csv_quoted().
+	 * @param buffer Buffer with room for 2 characters per input character, plus three.
+	 * @param s The field.
+	 * @param sep Field separator.
+	 * @return Pointer to the terminating zero.
+	 */
+	char* append_csv_quoted(char* buffer, string_view s, char sep = ',');
 
 	/**
 	 * @brief Format arguments to string.
@@ -464,6 +2343,13 @@ namespace cx {
 
 	/**
 	 * @brief Format arguments to string and return to invoker.
+	 *
+	 * Formats whose conversions are all plain %d %i %u %x %X (with length modifiers), %f %g (with
+	 * an optional precision), %s, %c or %% are written without vsnprintf, with the same output.
+	 * %J writes a const char* through append_json_escaped() and %Q through append_csv_quoted(); they
+	 * take no flags, width, precision or length. Other conversions in a format using %J or %Q go to
+	 * snprintf one at a time; output stops at one that cannot be passed on alone (%n, positional
+	 * arguments such as %1$s, or a modified %J/%Q).
 	 * @param fmt Format.
 	 * @return Result string.
 	 */
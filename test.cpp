@@ -1,6 +1,13 @@
 ﻿#include "stringutils.h"
 #include <iostream>
 #include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+#include <locale.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <map>
 
 #define ASSERT(EXP) \
 	if(!(EXP)) { \
@@ -8,6 +15,11 @@
 		return false; \
 	}
 
+// Lowercases 'I' to '!', to tell a locale apart from the classic one.
+struct BangCtype : std::ctype<char> {
+	char do_tolower(char c) const { return c == 'I' ? '!' : std::ctype<char>::do_tolower(c); }
+};
+
 bool test_stringutils() {
 	{
 		std::string s;
@@ -244,6 +256,779 @@ bool test_stringutils() {
 		ASSERT(sArray[1] == L"2");
 	}
 
+	{
+		cx::CaseContext ctx(std::locale::classic());
+		ASSERT(ctx.to_lower('A') == 'a');
+		ASSERT(ctx.to_upper(L'z') == L'Z');
+		ASSERT(&cx::CaseContext::global() == &cx::CaseContext::global());
+		ASSERT(cx::equals("AbC", "abc", true, ctx) == true);
+		ASSERT(cx::equals(L"AbC", L"abd", true, ctx) == false);
+		ASSERT(cx::starts_with("ABCDEF", "abc", true, ctx) == true);
+		ASSERT(cx::ends_with(L"ABCDEF", L"def", true, ctx) == true);
+		ASSERT(cx::contains("ABCDEF", "cd", true, ctx) == true);
+		ASSERT(cx::ccontains("ABCDEF", "cd", true, ctx) == true);
+		ASSERT(cx::to_lower_copy("ABC DEF", ctx) == "abc def");
+		ASSERT(cx::to_upper_copy(L"abc def", ctx) == L"ABC DEF");
+
+		ASSERT(cx::to_lower_copy("HI") == "hi");
+		const cx::CaseContext& before = cx::CaseContext::global();
+		std::locale old = std::locale::global(std::locale(std::locale::classic(), new BangCtype()));
+		ASSERT(&cx::CaseContext::global() == &before && cx::to_lower_copy("HI") == "hi");
+		const cx::CaseContext& bang = cx::CaseContext::refresh_global();
+		ASSERT(&cx::CaseContext::global() == &bang);
+		ASSERT(bang.to_lower('I') == '!' && cx::to_lower_copy("HI") == "h!");
+		std::locale::global(old);
+		ASSERT(&cx::CaseContext::refresh_global() == &before);
+		ASSERT(cx::to_lower_copy("HI") == "hi" && bang.to_lower('I') == '!');
+	}
+
+	{
+		ASSERT(cx::utf8_to_lower_copy("ABC \xC3\x80\xC3\x89\xC3\x8E \xD0\x9F") == "abc \xC3\xA0\xC3\xA9\xC3\xAE \xD0\xBF");
+		ASSERT(cx::utf8_to_upper_copy("abc \xC3\xA0\xC3\xA9\xC3\xAE \xD0\xBF") == "ABC \xC3\x80\xC3\x89\xC3\x8E \xD0\x9F");
+		ASSERT(cx::utf8_to_upper_copy("\xC4\xB1\xC5\xBF") == "IS");
+		ASSERT(cx::utf8_to_lower_copy("\xFF\xC3 A") == "\xFF\xC3 a");
+
+		std::string s = "THE QUICK BROWN FOX JUMPS OVER \xCE\xA3\xCE\x91";
+		cx::utf8_to_lower(s); ASSERT(s == "the quick brown fox jumps over \xCF\x83\xCE\xB1");
+		cx::utf8_to_upper(s); ASSERT(s == "THE QUICK BROWN FOX JUMPS OVER \xCE\xA3\xCE\x91");
+
+		ASSERT(cx::utf8_equals("Stra\xC3\x9F\x65 CAF\xC3\x89", "stra\xC3\x9F\x65 caf\xC3\xA9", true) == true);
+		ASSERT(cx::utf8_equals("CAF\xC3\x89", "caf\xC3\xA9") == false);
+		ASSERT(cx::utf8_equals("\xC5\xBF", "S", true) == true);
+		ASSERT(cx::utf8_equals("0123456789ABCDEFGHIJ", "0123456789abcdefghij", true) == true);
+		ASSERT(cx::utf8_equals("0123456789ABCDEFGHIJ", "0123456789abcdefghik", true) == false);
+		ASSERT(cx::utf8_starts_with("\xD0\x9F\xD0\xA0\xD0\x98", "\xD0\xBF\xD1\x80", true) == true);
+		ASSERT(cx::utf8_contains("x \xD0\x9F\xD0\xA0\xD0\x98 y", "\xD1\x80\xD0\xB8", true) == true);
+		ASSERT(cx::utf8_contains("x \xD0\x9F\xD0\xA0\xD0\x98 y", "\xD1\x80\xD0\xB8") == false);
+	}
+
+	{
+		std::string u8 = "ASCII only prefix, then \xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80 and more ASCII text";
+		std::wstring w;
+		ASSERT(cx::utf8_to_wide(u8, w) == true);
+		ASSERT(w[24] == 0xE9 && w[25] == 0x4E2D);
+		std::string back;
+		ASSERT(cx::wide_to_utf8(w, back) == true);
+		ASSERT(back == u8);
+
+		char16_t u16[64];
+		size_t len = 64;
+		ASSERT(cx::utf8_to_utf16(u8.data(), u8.size(), u16, len) == true);
+		ASSERT(u16[26] == 0xD83D && u16[27] == 0xDE00);
+		char out[256];
+		size_t outLen = sizeof(out);
+		ASSERT(cx::utf16_to_utf8(u16, len, out, outLen) == true);
+		ASSERT(std::string(out, outLen) == u8);
+
+		ASSERT(cx::utf8_to_wide("bad \xC3(", w) == false && w.empty());
+		ASSERT(cx::utf8_to_wide("\xE0\x80\x80", w) == false);
+		const char16_t lone[] = { 0x41, 0xD800, 0x42 };
+		outLen = sizeof(out);
+		ASSERT(cx::utf16_to_utf8(lone, 3, out, outLen) == false);
+		len = 4;
+		ASSERT(cx::utf8_to_utf16(u8.data(), u8.size(), u16, len) == false);
+	}
+
+	{
+		std::vector<std::string> sArray;
+		cx::split(" A ,b\t, C", ",", sArray);
+		cx::trim_all(sArray);
+		ASSERT(sArray[0] == "A" && sArray[1] == "b" && sArray[2] == "C");
+		cx::to_lower_all(sArray);
+		ASSERT(sArray[0] == "a" && sArray[2] == "c");
+		cx::to_upper_all(sArray);
+		ASSERT(sArray[1] == "B");
+		ASSERT(cx::contains_any_of(sArray, "c") == false);
+		ASSERT(cx::contains_any_of(sArray, "c", true) == true);
+
+		std::vector<std::wstring> big(20000, L" Token ");
+		big[15000] = L" Needle ";
+		cx::trim_all(big, 4);
+		cx::to_lower_all(big, 4);
+		ASSERT(big[0] == L"token" && big[19999] == L"token");
+		ASSERT(cx::contains_any_of(big, std::wstring(L"needle"), false, 4) == true);
+		ASSERT(cx::contains_any_of(big, std::wstring(L"NEEDLE"), false, 4) == false);
+	}
+
+	{
+		std::vector<std::string> sArray;
+		ASSERT(cx::join(sArray, ",") == "");
+		cx::split("1,,2,3", ",", sArray);
+		ASSERT(cx::join(sArray, ",") == "1,,2,3");
+		ASSERT(cx::join(sArray, "") == "123");
+
+		std::list<std::wstring> sList;
+		cx::split(L"a b c", L" ", sList);
+		ASSERT(cx::join(sList, L", ") == L"a, b, c");
+
+		std::vector<cx::string_view> views;
+		views.push_back("key");
+		views.push_back(cx::string_view("value123", 5));
+		ASSERT(cx::join(views, "=") == "key=value");
+
+		std::string dst = "record: ";
+		cx::join_into(dst, sArray, "|");
+		ASSERT(dst == "record: 1||2|3");
+
+		std::vector<std::string> big(300000, "0123456789");
+		std::string joined;
+		cx::join_into(joined, big, ";", 4);
+		ASSERT(joined.size() == 300000 * 11 - 1);
+		ASSERT(joined.compare(0, 22, "0123456789;0123456789;") == 0);
+		ASSERT(joined == cx::join(big, ";"));
+	}
+
+	{
+		std::string s = "one two one three one";
+		ASSERT(cx::replace_all(s, "one", "1") == 3);
+		ASSERT(s == "1 two 1 three 1");
+		ASSERT(cx::replace_all(s, "1", "one") == 3);
+		ASSERT(s == "one two one three one");
+		ASSERT(cx::replace_all(s, "", "x") == 0);
+		ASSERT(cx::replace_all(s, "ONE", "", true) == 3);
+		ASSERT(s == " two  three ");
+		ASSERT(cx::replace_all_copy("aaaa", "aa", "b") == "bb");
+		ASSERT(cx::replace_all_copy("abc", "x", "y") == "abc");
+		ASSERT(cx::replace_all_copy(L"Path/To/File", L"/", L"\\") == L"Path\\To\\File");
+		ASSERT(cx::replace_all_copy(L"AbcABC", L"abc", L"x", true) == L"xx");
+
+		cx::Replacer r;
+		r.add("&", "&amp;").add("<", "&lt;").add(">", "&gt;");
+		ASSERT(r.apply_copy("a<b && c>d") == "a&lt;b &amp;&amp; c&gt;d");
+
+		cx::Replacer shrink(true);
+		shrink.add("ab", "x").add("abc", "y").add("C", "");
+		std::string t = "ABCabAbc c";
+		ASSERT(shrink.apply(t) == 4);
+		ASSERT(t == "yxy ");
+	}
+
+	{
+		const char* csv = "id,name,note\r\n1,\"Smith, John\",\"said \"\"hi\"\"\"\n2,,\"multi\nline\"\n"
+			"3,\"a field long enough to make the record span more than one sixty-four byte block, with, commas\",x\n4,last";
+		cx::CsvReader reader;
+		std::vector<cx::string_view> fields;
+		std::vector<std::vector<std::string> > records;
+		size_t len = strlen(csv);
+		for (size_t i = 0; i < len; i += 7) {
+			reader.feed(csv + i, std::min((size_t)7, len - i));
+			while (reader.next(fields)) {
+				records.push_back(std::vector<std::string>());
+				for (size_t j = 0; j < fields.size(); j++) records.back().push_back(fields[j].str());
+			}
+		}
+		ASSERT(records.size() == 4);
+		reader.finish();
+		ASSERT(reader.next(fields) == true);
+		ASSERT(fields.size() == 2 && fields[1] == "last");
+		ASSERT(reader.next(fields) == false);
+
+		ASSERT(records[0].size() == 3 && records[0][2] == "note");
+		ASSERT(records[1][1] == "Smith, John");
+		ASSERT(records[1][2] == "said \"hi\"");
+		ASSERT(records[2].size() == 3 && records[2][1] == "" && records[2][2] == "multi\nline");
+		ASSERT(records[3].size() == 3 && cx::ends_with(records[3][1], "with, commas") && records[3][2] == "x");
+	}
+
+	{
+		std::string line = "a, b ,c,,e";
+		cx::FieldIndex one(line.data(), line.size(), ',');
+		ASSERT(one.row_count() == 1 && one.field_count(0) == 5);
+		ASSERT(one.field(0, 0) == "a");
+		ASSERT(one.field(0, 1) == " b " && one.field(0, 1, true) == "b");
+		ASSERT(one.field(0, 3) == "" && one.field(0, 4) == "e");
+		ASSERT(one.field(0, 5).empty() && one.field(1, 0).empty());
+
+		std::string buf;
+		for (int i = 0; i < 20; i++)
+			buf += cx::format("%d;col1;col2;col3;%d\r\n", i, i * 10);
+		cx::FieldIndex idx(buf.data(), buf.size(), ';');
+		ASSERT(idx.row_count() == 20);
+		ASSERT(idx.field(0, 0) == "0" && idx.field(0, 4) == "0");
+		ASSERT(idx.field(17, 0) == "17" && idx.field(17, 4) == "170");
+		ASSERT(idx.field(19, 2) == "col2");
+
+		cx::FieldIndex empty(NULL, 0, ',');
+		ASSERT(empty.row_count() == 1 && empty.field_count(0) == 1 && empty.field(0, 0).empty());
+	}
+
+	{
+		std::vector<std::string> sArray;
+		cx::split_n("key=value=more", "=", 2, sArray);
+		ASSERT(sArray.size() == 2 && sArray[0] == "key" && sArray[1] == "value=more");
+		cx::split_n("a,b,c", ",", 0, sArray);
+		ASSERT(sArray.size() == 3);
+		cx::split_n("a,b,c", ",", 5, sArray);
+		ASSERT(sArray.size() == 3 && sArray[2] == "c");
+		cx::split_n("a,b,", ",", 3, sArray);
+		ASSERT(sArray.size() == 3 && sArray[2] == "");
+		cx::split_n(",,a,,,b, c ", ",", 2, sArray, true, true);
+		ASSERT(sArray.size() == 2 && sArray[0] == "a" && sArray[1] == "b, c");
+		cx::split_n("a,,", ",", 2, sArray, true);
+		ASSERT(sArray.size() == 1 && sArray[0] == "a");
+
+		std::vector<std::wstring> wArray;
+		cx::split_n(L"INFO  rest of line", L" ", 2, wArray);
+		ASSERT(wArray.size() == 2 && wArray[0] == L"INFO" && wArray[1] == L" rest of line");
+
+		std::string field;
+		ASSERT(cx::field_at("ERROR|disk|full", "|", 0, field) && field == "ERROR");
+		ASSERT(cx::field_at("ERROR|disk|full", "|", 2, field) && field == "full");
+		ASSERT(cx::field_at("ERROR|disk|full", "|", 3, field) == false);
+		ASSERT(cx::field_at("a,,b", ",", 1, field) && field == "");
+		ASSERT(cx::field_at("a,,b", ",", 1, field, true) && field == "b");
+		ASSERT(cx::field_at("a, b ,c", ",", 1, field, false, true) && field == "b");
+		std::wstring wfield;
+		ASSERT(cx::field_at(L"x y z", L" ", 1, wfield) && wfield == L"y");
+	}
+
+	{
+		std::vector<int> ints;
+		std::vector<size_t> bad;
+		ASSERT(cx::split_parse("1, -22 ,+333,2147483647,-2147483648", ",", ints) == 0);
+		ASSERT(ints.size() == 5 && ints[0] == 1 && ints[1] == -22 && ints[2] == 333);
+		ASSERT(ints[3] == 2147483647 && ints[4] == -2147483647 - 1);
+		ASSERT(cx::split_parse("7,x,2147483648,,12345678901234", ",", ints, &bad) == 4);
+		ASSERT(ints.size() == 5 && ints[0] == 7 && ints[1] == 0);
+		ASSERT(bad.size() == 4 && bad[0] == 1 && bad[1] == 2 && bad[2] == 3 && bad[3] == 4);
+		ASSERT(cx::split_parse("1,,2", ",", ints, &bad, true) == 0 && ints.size() == 2);
+
+		std::vector<unsigned long long> big;
+		ASSERT(cx::split_parse("18446744073709551615 12345678901234567", " ", big) == 0);
+		ASSERT(big[0] == 18446744073709551615ULL && big[1] == 12345678901234567ULL);
+		ASSERT(cx::split_parse("18446744073709551616;-1", ";", big) == 2);
+
+		std::vector<double> doubles;
+		ASSERT(cx::split_parse("1.5,-0.25,3e2,1e-3,0.1,123456789012345678901234567890,1.7976931348623157e308,inf", ",", doubles) == 0);
+		ASSERT(doubles[0] == 1.5 && doubles[1] == -0.25 && doubles[2] == 300.0 && doubles[3] == 0.001 && doubles[4] == 0.1);
+		ASSERT(doubles[5] == 123456789012345678901234567890.0 && doubles[6] == 1.7976931348623157e308);
+		ASSERT(doubles[7] > 1e308);
+		ASSERT(cx::split_parse("1.2.3,e5,.5,5.", ",", doubles, &bad) == 2 && bad[0] == 0 && bad[1] == 1);
+		ASSERT(doubles[2] == 0.5 && doubles[3] == 5.0);
+
+		std::vector<float> floats;
+		ASSERT(cx::split_parse("0.1 2.5 16777217", " ", floats) == 0);
+		ASSERT(floats[0] == 0.1f && floats[1] == 2.5f && floats[2] == 16777216.0f);
+
+		// The strtod fallback takes '.' whatever the LC_NUMERIC decimal point is.
+		const char* slow = "0.12345678901234567890;1.5e400;-inf;1,5";
+		ASSERT(cx::split_parse(slow, ";", doubles, &bad) == 1 && bad[0] == 3);
+		ASSERT(doubles[0] == 0.12345678901234567890 && doubles[1] > 1e308 && doubles[2] < -1e308);
+		const char* commaLocales[] = { "de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "German_Germany.1252" };
+		std::string savedNumeric = setlocale(LC_NUMERIC, NULL);
+		for (size_t i = 0; i < sizeof(commaLocales) / sizeof(commaLocales[0]); i++) {
+			if (setlocale(LC_NUMERIC, commaLocales[i]) == NULL || localeconv()->decimal_point[0] != ',') continue;
+			ASSERT(cx::split_parse(slow, ";", doubles, &bad) == 1 && bad[0] == 3);
+			ASSERT(doubles[0] == 0.12345678901234567890 && doubles[1] > 1e308 && doubles[2] < -1e308);
+			break;
+		}
+		setlocale(LC_NUMERIC, savedNumeric.c_str());
+	}
+
+	{
+		cx::InternPool pool;
+		std::vector<unsigned int> ids;
+		cx::InternPool emptyPool;
+		unsigned int emptyId = emptyPool.intern(NULL, 0);
+		ASSERT(emptyPool.intern_view(cx::string_view()).empty() && emptyPool.intern(std::string()) == emptyId);
+		ASSERT(emptyPool.view(emptyId).empty() && emptyPool.size() == 1);
+		cx::split("GET, POST,GET ,,PUT", ",", pool, ids, true, true);
+		ASSERT(ids.size() == 4 && ids[0] == ids[2] && ids[0] != ids[1]);
+		ASSERT(pool.size() == 3);
+		ASSERT(pool.view(ids[1]) == "POST");
+		unsigned int id;
+		ASSERT(pool.find("PUT", id) && id == ids[3]);
+		ASSERT(pool.find("DELETE", id) == false);
+		ASSERT(pool.intern_view(std::string("GET")).data() == pool.view(ids[0]).data());
+
+		std::vector<std::vector<unsigned int> > perThread(4);
+		std::vector<std::thread> workers;
+		for (size_t t = 0; t < perThread.size(); t++) {
+			workers.push_back(std::thread([&pool, &perThread, t]() {
+				for (int i = 0; i < 5000; i++)
+					perThread[t].push_back(pool.intern(cx::format("host-%d", i % 1000)));
+			}));
+		}
+		for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+		ASSERT(pool.size() == 1003);
+		ASSERT(perThread[0] == perThread[3]);
+		ASSERT(pool.view(perThread[2][1234]) == "host-234");
+
+		// Readers run against a writer that keeps growing the tables and adding chunks.
+		cx::InternPool busy(2);
+		std::vector<unsigned int> busyIds;
+		for (int i = 0; i < 100; i++) busyIds.push_back(busy.intern(cx::format("k%d", i)));
+		std::atomic<bool> done(false);
+		std::atomic<int> readErrors(0);
+		std::vector<std::thread> readers;
+		for (int t = 0; t < 3; t++) {
+			readers.push_back(std::thread([&]() {
+				while (!done.load()) {
+					for (int i = 0; i < 100; i++) {
+						unsigned int found;
+						std::string key = cx::format("k%d", i);
+						if (!busy.find(key, found) || found != busyIds[i] || busy.view(found) != key || busy.intern(key) != found)
+							readErrors++;
+					}
+				}
+			}));
+		}
+		for (int i = 100; i < 50000; i++) busy.intern(cx::format("k%d", i));
+		done = true;
+		for (size_t t = 0; t < readers.size(); t++) readers[t].join();
+		ASSERT(readErrors == 0 && busy.size() == 50000);
+		unsigned int last;
+		ASSERT(busy.find("k49999", last) && busy.view(last) == "k49999" && busy.view(cx::InternPool::invalid_id).empty());
+	}
+
+	{
+		cx::Glob host("*.internal.*");
+		ASSERT(host.match("db.internal.example.com"));
+		ASSERT(host.match("db.internal") == false && host.match("internal.com") == false);
+		cx::Glob route("api/v?/users*");
+		ASSERT(route.match("api/v2/users") && route.match("api/v1/users/42"));
+		ASSERT(route.match("api/v10/users") == false);
+		cx::Glob cls("file[0-9][!a-c]\\*.[Tt][Xx][Tt]");
+		ASSERT(cls.match("file7d*.txt") && cls.match("file0z*.TXT"));
+		ASSERT(cls.match("file7a*.txt") == false && cls.match("file7dx.txt") == false);
+		cx::Glob icase("*.JPG", true);
+		ASSERT(icase.match("photo.jpg") && icase.match(".Jpg") && icase.match("jpg") == false);
+		ASSERT(cx::Glob("[]a]?[z-").match("]b[z-"));
+		ASSERT(cx::Glob("[]a]?[z-").match("]bzz-") == false);
+		ASSERT(cx::Glob("[ab?x").match("[abzx") && cx::Glob("[ab?x").match("aabzx") == false);
+		ASSERT(cx::Glob().match("") && cx::Glob().match("a") == false);
+		ASSERT(cx::Glob("*").match("") && cx::Glob("**").match("abc"));
+		cx::Glob slow("a*a*a*a*a*a*a*a*b");
+		ASSERT(slow.match(std::string(100000, 'a')) == false);
+		ASSERT(slow.match(std::string(100000, 'a') + "b"));
+		ASSERT(cx::Glob("*x?z*y").match("axxzxyzy"));
+	}
+
+	{
+		std::vector<cx::StreamMatch> matches;
+		cx::StreamSearcher single("boundary");
+		ASSERT(single.feed("--bound", 7, matches) == 0);
+		ASSERT(single.feed("ary--boundary", 13, matches) == 2);
+		ASSERT(matches[0].offset == 2 && matches[1].offset == 12 && single.offset() == 20);
+
+		matches.clear();
+		cx::StreamSearcher multi(true);
+		multi.add("he").add("SHE").add("his").add("hers").add("");
+		const char* text = "uSHErs and His";
+		for (size_t i = 0; text[i]; i++) multi.feed(text + i, 1, matches);
+		ASSERT(matches.size() == 4);
+		ASSERT(matches[0].offset == 1 && matches[0].needle == 1);
+		ASSERT(matches[1].offset == 2 && matches[1].needle == 0);
+		ASSERT(matches[2].offset == 2 && matches[2].needle == 3);
+		ASSERT(matches[3].offset == 11 && matches[3].needle == 2);
+
+		matches.clear();
+		multi.reset();
+		ASSERT(multi.feed("hishe", 5, matches) == 3 && matches[2].offset == 3);
+
+		cx::StreamSearcher overlap("aa");
+		matches.clear();
+		ASSERT(overlap.feed("aaaa", 4, matches) == 3);
+	}
+
+	{
+		ASSERT(cx::contains_approx("please reset my pasword", "password", 1));
+		ASSERT(cx::contains_approx("please reset my pasword", "password", 0) == false);
+		ASSERT(cx::contains_approx("UNAUTHORISED access", "unauthorized", 1, true));
+		ASSERT(cx::contains_approx("abc", "", 0) && cx::contains_approx("", "ab", 2));
+		cx::ApproxMatcher m("kitten");
+		ASSERT(m.distance("sitting") == 2 && m.distance("a mitten here") == 1);
+		ASSERT(m.contains("the kitchen", 2) && m.contains("the kitchen", 1) == false);
+		std::string longNeedle(70, 'x'), hay = "aa" + std::string(30, 'x') + "y" + std::string(64, 'x') + "bb";
+		ASSERT(cx::ApproxMatcher(longNeedle).distance(hay) == 1);
+		longNeedle.resize(64);
+		ASSERT(cx::ApproxMatcher(longNeedle).distance(hay) == 0);
+	}
+
+	{
+		std::string s = " \t the  quick\r\nbrown fox \v";
+		cx::normalize_space(s);
+		ASSERT(s == "the quick brown fox");
+		std::string clean = "already normalized text, long enough for whole blocks";
+		ASSERT(cx::normalize_space_copy(clean) == clean);
+		std::string mixed = clean + "   " + clean + "\t\t" + clean + "\n";
+		ASSERT(cx::normalize_space_copy(mixed) == clean + " " + clean + " " + clean);
+		ASSERT(cx::normalize_space_copy(std::string(40, ' ')).empty() && cx::normalize_space_copy("").empty());
+		ASSERT(cx::normalize_space_copy("--a-_-b--", "-_") == "a b");
+		std::wstring ws = L"  wide\t\tstring  ";
+		cx::normalize_space(ws, ws);
+		ASSERT(ws == L"wide string");
+		ASSERT(cx::normalize_space_copy(std::wstring(L"\x3000" L"a\x3000\x3000" L"b"), std::wstring(L"\x3000")) == L"a b");
+	}
+
+	{
+		ASSERT(cx::compare("abc", "abd") < 0 && cx::compare("abc", "ab") > 0 && cx::compare("", "") == 0);
+		ASSERT(cx::compare("ABC", "abc") < 0 && cx::compare("ABC", "abc", true) == 0);
+		ASSERT(cx::compare(std::string("a\xE9"), std::string("az")) > 0);
+		ASSERT(cx::compare(std::wstring(L"Zeta"), std::wstring(L"alpha"), true) > 0);
+		ASSERT(cx::compare_natural("file2.txt", "file10.txt") < 0 && cx::compare_natural("file02", "file2") == 0);
+		ASSERT(cx::compare_natural("v1.10", "V1.9", true) > 0 && cx::compare_natural("a1", "a") > 0);
+		ASSERT(cx::compare_natural(std::wstring(L"img12"), std::wstring(L"img9")) > 0);
+
+		const char* names[] = { "file10", "File2", "file2b", "file1", "file", "file007", "file 3", "File20", "file100x", "file0" };
+		std::vector<std::string> v(names, names + sizeof(names) / sizeof(names[0]));
+		for (int mode = 0; mode < 4; mode++) {
+			bool ignoreCase = (mode & 1) != 0, natural = (mode & 2) != 0;
+			for (size_t i = 0; i < v.size(); i++) {
+				for (size_t j = 0; j < v.size(); j++) {
+					int r = natural ? cx::compare_natural(v[i], v[j], ignoreCase) : cx::compare(v[i], v[j], ignoreCase);
+					int k = cx::make_sort_key(v[i], ignoreCase, natural).compare(cx::make_sort_key(v[j], ignoreCase, natural));
+					ASSERT((r < 0) == (k < 0) && (r > 0) == (k > 0));
+				}
+			}
+		}
+
+		std::wstring w1 = L"x\x00e9", w2 = L"x\x4e2d", w3 = L"x~";
+		ASSERT(cx::make_sort_key(w3) < cx::make_sort_key(w1) && cx::make_sort_key(w1) < cx::make_sort_key(w2));
+		ASSERT(cx::make_sort_key(std::wstring(L"Item10"), true, true) > cx::make_sort_key(std::wstring(L"item9"), true, true));
+	}
+
+	{
+		std::vector<std::string> v;
+		for (int i = 0; i < 3000; i++)
+			v.push_back(cx::format(i % 3 ? "key_%05d" : "KEY_%d", (i * 7919) % 1000) + std::string(i % 5, '\0'));
+		v.push_back("");
+		v.push_back("key");
+		std::vector<std::string> expected = v;
+		std::sort(expected.begin(), expected.end());
+		std::vector<std::string> sorted = v;
+		cx::sort_strings(sorted);
+		ASSERT(sorted == expected);
+
+		// Large enough for four workers, so the parallel bucket split runs.
+		std::vector<std::string> many;
+		for (int i = 0; i < 140000; i++)
+			many.push_back(cx::format(i % 3 ? "key_%05d" : "KEY_%d", (i * 7919) % 50000) + std::string(i % 5, '\0'));
+		sorted = many;
+		cx::sort_strings(sorted, true, 4);
+		for (size_t i = 1; i < sorted.size(); i++)
+			ASSERT(cx::compare(sorted[i - 1], sorted[i], true) <= 0);
+		std::sort(sorted.begin(), sorted.end());
+		std::sort(many.begin(), many.end());
+		ASSERT(sorted == many);
+
+		// Sawtooth and organ-pipe keys, patterns that unbalance median-of-three partitioning.
+		std::vector<std::string> skewed;
+		for (int i = 0; i < 20000; i++)
+			skewed.push_back(cx::format("%08d", i < 10000 ? i : 20000 - i) + (i % 2 ? "b" : "a"));
+		for (int i = 0; i < 20000; i++)
+			skewed.push_back(cx::format("%08d", i % 97));
+		expected = skewed;
+		std::sort(expected.begin(), expected.end());
+		cx::sort_strings(skewed);
+		ASSERT(skewed == expected);
+
+		std::vector<std::wstring> w;
+		for (int i = 0; i < 100000; i++)
+			w.push_back(std::wstring(i % 2 ? L"\x4e2d" : L"z") + std::to_wstring((i * 7919) % 5000));
+		std::vector<std::wstring> wexpected = w;
+		std::sort(wexpected.begin(), wexpected.end(), [](const std::wstring& a, const std::wstring& b) { return cx::compare(a, b) < 0; });
+		cx::sort_strings(w, false, 4);
+		ASSERT(w == wexpected);
+	}
+
+	{
+		FILE* file = tmpfile();
+		std::string longLine(100, 'x');
+		std::string text = "id, name\r\n1, alpha\n\n" + longLine + "\n2,beta,,gamma";
+		fwrite(text.data(), 1, text.size(), file);
+		rewind(file);
+
+		cx::AsyncLineSource src(16, 2);
+		ASSERT(src.attach(file));
+		cx::string_view line;
+		std::vector<cx::string_view> fields;
+		ASSERT(src.next_fields(",", fields, false, true) && fields.size() == 2 && fields[1] == "name");
+		ASSERT(src.next_line(line) && line == "1, alpha");
+		ASSERT(src.next_line(line) && line.empty());
+		ASSERT(src.next_line(line) && line == longLine);
+		ASSERT(src.next_fields(",", fields, true) && fields.size() == 3 && fields[2] == "gamma");
+		ASSERT(src.next_line(line) == false && src.error() == false);
+
+		rewind(file);
+		std::string joined;
+		cx::string_view chunk;
+		ASSERT(src.attach(file));
+		while (src.next_chunk(chunk)) {
+			ASSERT(chunk.data()[chunk.size() - 1] == '\n' || joined.size() + chunk.size() == text.size());
+			joined.append(chunk.data(), chunk.size());
+		}
+		ASSERT(joined == text);
+
+		rewind(file);
+		ASSERT(src.attach(file) && src.next_line(line));
+		src.close();
+		fclose(file);
+		ASSERT(src.next_line(line) == false);
+		ASSERT(src.open("/nonexistent/dir/file.txt") == false);
+	}
+
+	{
+		std::vector<std::string> lines, expected, results;
+		for (int i = 0; i < 5000; i++) {
+			lines.push_back(cx::format(" Row%d ; ERROR code %d ;  ok ", i, i % 7));
+			expected.push_back(cx::format("row%d", i));
+			if (i % 7 == 3) expected.push_back(cx::format("error code %d", i % 7));
+			expected.push_back("ok");
+		}
+
+		cx::Pipeline pipeline(3, true, 16);
+		pipeline.split(";", true, true).to_lower().filter([](const std::string& s) { return s.find("code") == std::string::npos || s.find('3') != std::string::npos; });
+		pipeline.run(lines, results);
+		ASSERT(results == expected);
+
+		cx::Pipeline unordered(4, false, 7);
+		unordered.normalize_space().filter_contains("ERROR CODE 3", true).map([](std::string& s) { s.resize(3); });
+		std::thread producer([&unordered, &lines]() {
+			for (size_t i = 0; i < lines.size(); i++) unordered.push(lines[i]);
+			unordered.close();
+		});
+		std::vector<std::string> batch;
+		size_t count = 0;
+		while (unordered.next_batch(batch)) {
+			for (size_t i = 0; i < batch.size(); i++) ASSERT(batch[i] == "Row");
+			count += batch.size();
+		}
+		producer.join();
+		ASSERT(count == 714 && unordered.next_batch(batch) == false);
+
+		cx::Pipeline empty(2);
+		empty.trim().to_upper();
+		empty.run(std::vector<std::string>(), results);
+		ASSERT(results.empty());
+
+		cx::Pipeline abandoned(2, true, 1);
+		for (int i = 0; i < 8; i++) abandoned.push("x");
+
+		// A stalled first batch holds the producer back instead of piling up later batches.
+		std::atomic<bool> release(false);
+		std::atomic<int> pushed(0);
+		cx::Pipeline stalled(2, true, 1);
+		stalled.map([&release](std::string& s) { while (s == "0" && !release) std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+		std::thread feeder([&stalled, &pushed]() {
+			for (int i = 0; i < 1000; i++) {
+				stalled.push(cx::format("%d", i));
+				pushed++;
+			}
+			stalled.close();
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		ASSERT(pushed <= 10);
+		release = true;
+		int nextExpected = 0;
+		while (stalled.next_batch(batch)) {
+			for (size_t i = 0; i < batch.size(); i++) ASSERT(batch[i] == cx::format("%d", nextExpected++));
+		}
+		feeder.join();
+		ASSERT(nextExpected == 1000);
+	}
+
+	{
+		std::string s = "\t  padded value \t";
+		cx::trim<' ', '\t'>(s);
+		ASSERT(s == "padded value");
+		s = "--x--";
+		cx::trim_start<'-'>(s);
+		ASSERT(s == "x--");
+		cx::trim_end<'-'>(s);
+		ASSERT(s == "x");
+		std::wstring ws = L"\x00e9\x4e2d*\x00e9";
+		cx::trim<'*', '\xE9'>(ws);
+		ASSERT(ws == L"\x4e2d");
+		typedef cx::CharSet<'a', '\xFF'> HighSet;
+		ASSERT(HighSet::contains('\xFF') && HighSet::contains(L'\x00FF') && !HighSet::contains(L'\x01FF') && !HighSet::contains('b'));
+		ASSERT(cx::SpaceChars::contains('\v') && !cx::SpaceChars::contains('x'));
+
+		std::vector<std::string> fields;
+		cx::split<','>(std::string("a,,b, c"), fields);
+		ASSERT(fields.size() == 4 && fields[1].empty() && fields[3] == " c");
+		cx::split<',', ';'>(std::string(" a ;b,, c "), fields, true, true);
+		ASSERT(fields.size() == 3 && fields[0] == "a" && fields[2] == "c");
+		cx::split<','>(std::string(), fields);
+		ASSERT(fields.empty());
+		std::list<std::wstring> wfields;
+		cx::split<'|'>(std::wstring(L"x|\x4e2d|"), wfields);
+		ASSERT(wfields.size() == 3 && wfields.back().empty());
+
+		std::vector<std::string> expected;
+		cx::split(std::string("k=v;;x = y;"), std::string(";="), expected, true, true);
+		cx::split<';', '='>(std::string("k=v;;x = y;"), fields, true, true);
+		ASSERT(fields == expected);
+	}
+
+	{
+		cx::CaseContext ctx(std::locale::classic());
+		ASSERT(ctx.wide_ascii_simple());
+		std::wstring ws = L" \t\r\n  \v  wide value with spaces \f \n     ";
+		ASSERT(cx::trim_copy(ws) == L"wide value with spaces");
+		ASSERT(cx::trim_start_copy(std::wstring(L"           ")).empty());
+		ASSERT(cx::trim_end_copy(std::wstring(L"\x3000         ")) == L"\x3000");
+
+		std::wstring mixed = L"Hello World, \x4e2d\x6587 Text And MORE ascii";
+		ASSERT(cx::to_lower_copy(mixed, ctx) == L"hello world, \x4e2d\x6587 text and more ascii");
+		ASSERT(cx::to_upper_copy(mixed, ctx) == L"HELLO WORLD, \x4e2d\x6587 TEXT AND MORE ASCII");
+		ASSERT(cx::equals(mixed, std::wstring(L"hello WORLD, \x4e2d\x6587 text and more ASCII"), true, ctx));
+		ASSERT(!cx::equals(mixed, std::wstring(L"hello WORLD, \x4e2d\x6587 text and more ASCIJ"), true, ctx));
+		ASSERT(!cx::equals(mixed, std::wstring(L"Hello World, \x4e2d\x6587 Text And MORE asciI"), false, ctx));
+		ASSERT(cx::starts_with(mixed, std::wstring(L"HELLO world, \x4e2d"), true, ctx));
+		ASSERT(cx::ends_with(mixed, std::wstring(L"more ascii"), true, ctx) && !cx::ends_with(mixed, std::wstring(L"more ascii"), false, ctx));
+
+		ASSERT(cx::contains(mixed, std::wstring(L"TEXT and"), true, ctx));
+		ASSERT(!cx::contains(mixed, std::wstring(L"TEXT and"), false, ctx));
+		ASSERT(cx::contains(mixed, std::wstring(L"\x6587 Text"), false, ctx));
+		ASSERT(cx::contains(mixed, std::wstring(L"\x6587 text"), true, ctx));
+		ASSERT(cx::contains(mixed, std::wstring(), true, ctx) && !cx::contains(std::wstring(L"abc"), std::wstring(L"abcd"), true, ctx));
+
+		std::vector<std::wstring> fields;
+		cx::split(std::wstring(L"alpha,beta;;gamma , delta,\x4e2d;"), std::wstring(L",;"), fields);
+		ASSERT(fields.size() == 7 && fields[2].empty() && fields[3] == L"gamma " && fields[5] == L"\x4e2d" && fields[6].empty());
+		cx::split(std::wstring(L"alpha,beta;;gamma , delta,\x4e2d;"), std::wstring(L",;"), fields, true, true);
+		ASSERT(fields.size() == 5 && fields[2] == L"gamma" && fields[3] == L"delta");
+		cx::split(std::wstring(), std::wstring(L","), fields);
+		ASSERT(fields.empty());
+	}
+
+	{
+		typedef cx::InlineString<15> Token;
+		Token t("short");
+		ASSERT(t.is_inline() && t.size() == 5 && t == "short" && t.capacity() == 15);
+		t.append(" and then much longer", 21);
+		ASSERT(!t.is_inline() && t == std::string("short and then much longer") && strlen(t.c_str()) == t.size());
+		t.append(t.data(), 5);
+		ASSERT(t == "short and then much longershort");
+		t.assign(t.data() + 6, 3);
+		ASSERT(t == "and" && !t.is_inline());
+		Token moved(std::move(t));
+		ASSERT(moved == "and" && t.empty() && t.is_inline());
+		Token copy = moved;
+		copy.push_back('!');
+		ASSERT(copy == "and!" && moved == "and" && copy != moved && moved < copy);
+		copy.resize(1);
+		ASSERT(copy == cx::string_view("a"));
+
+		std::vector<Token> tokens;
+		cx::split(std::string("alpha, beta,,a token longer than fifteen chars ,"), std::string(","), tokens);
+		ASSERT(tokens.size() == 5 && tokens[1] == " beta" && tokens[2].empty() && tokens[4].empty());
+		ASSERT(tokens[0].is_inline() && !tokens[3].is_inline());
+		cx::split(std::string("alpha, beta,,a token longer than fifteen chars ,"), std::string(","), tokens, true, true);
+		ASSERT(tokens.size() == 3 && tokens[1] == "beta" && tokens[2] == "a token longer than fifteen chars");
+		std::vector<std::string> expected;
+		cx::split(std::string(";x;; y ;z"), std::string(";"), expected, true, true);
+		cx::split(std::string(";x;; y ;z"), std::string(";"), tokens, true, true);
+		ASSERT(tokens.size() == expected.size() && tokens[1] == expected[1] && tokens[2].str() == expected[2]);
+		cx::split(std::string(), std::string(","), tokens);
+		ASSERT(tokens.empty());
+	}
+
+	{
+		std::string s = "n=";
+		cx::append_int(s, -9223372036854775807LL - 1);
+		s += ' ';
+		cx::append_uint(s, 18446744073709551615ULL);
+		s += ' ';
+		cx::append_hex(s, 0xBEEF);
+		s += ' ';
+		cx::append_hex(s, 0, true);
+		ASSERT(s == "n=-9223372036854775808 18446744073709551615 beef 0");
+
+		char buffer[32];
+		ASSERT(*cx::append_int(buffer, 42) == '\0' && std::string(buffer) == "42");
+		ASSERT(cx::append_hex(buffer, 0xABCDEF, true) == buffer + 6 && std::string(buffer) == "ABCDEF");
+		const double values[] = { 0.1, 1.0 / 3, 1e21, 5e-324, 1.7976931348623157e308, -2.5, 123456789.125, 0.0001, 1e-5 };
+		const char* texts[] = { "0.1", "0.3333333333333333", "1e+21", "5e-324", "1.7976931348623157e+308", "-2.5", "123456789.125", "0.0001", "1e-05" };
+		for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+			cx::append_double(buffer, values[i]);
+			ASSERT(std::string(buffer) == texts[i] && strtod(buffer, NULL) == values[i]);
+		}
+		s.clear();
+		cx::append_double(s, -0.0);
+		cx::append_double(s, 100);
+		ASSERT(s == "-0100");
+
+		char expected[512];
+		snprintf(expected, sizeof(expected), "%d|%u|%x|%X|%lld|%zu|%hd|%f|%.2f|%g|%.3g|%g|%f|%s|%c|%%", -7, 7u, 255u, 255u, -1LL, (size_t)9, (short)-3,
+			2.675, 2.675, 123456.5, 0.00012345, 1e100, 1e300, "str", 'c');
+		ASSERT(cx::format("%d|%u|%x|%X|%lld|%zu|%hd|%f|%.2f|%g|%.3g|%g|%f|%s|%c|%%", -7, 7u, 255u, 255u, -1LL, (size_t)9, (short)-3,
+			2.675, 2.675, 123456.5, 0.00012345, 1e100, 1e300, "str", 'c') == expected);
+		ASSERT(cx::format("%5d|%-3s|%e", 42, "a", 1.5) == "   42|a  |1.500000e+00");
+		ASSERT(std::string(cx::format_to_buffer(buffer, "%d:%x:%.1f", 12, 255u, 0.25)) == "12:ff:0.2");
+	}
+
+	{
+		std::string text = "b a  c,a B a";
+		std::vector<cx::TokenCount> counts;
+		cx::count_tokens(text, " ,", counts);
+		ASSERT(counts.size() == 4 && counts[0].token == "a" && counts[0].count == 3);
+		ASSERT(counts[1].token == "b" && counts[2].token == "c" && counts[3].token == "B" && counts[3].count == 1);
+		cx::count_tokens(text, " ,", counts, true);
+		ASSERT(counts.size() == 3 && counts[1].token == "b" && counts[1].count == 2 && counts[1].token.data() == text.data());
+		cx::count_tokens(std::string(" , "), " ,", counts);
+		ASSERT(counts.empty());
+
+		std::string big;
+		std::map<std::string, size_t> expected;
+		for (int i = 0; i < 200000; i++) {
+			std::string token = cx::format(i % 2 ? "Key%d" : "key%d", (i * 7919) % 5000);
+			big += token;
+			big += i % 10 ? ' ' : '\n';
+			expected[cx::to_lower_copy(token)]++;
+		}
+		cx::count_tokens(big, " \n", counts, true, 4);
+		ASSERT(counts.size() == expected.size());
+		size_t total = 0;
+		for (size_t i = 0; i < counts.size(); i++) {
+			ASSERT(expected[cx::to_lower_copy(counts[i].token.str())] == counts[i].count);
+			ASSERT(i == 0 || counts[i - 1].count >= counts[i].count);
+			total += counts[i].count;
+		}
+		ASSERT(total == 200000);
+
+		std::vector<cx::TokenCount> top;
+		cx::count_tokens(big, " \n", top, true, 1, 10);
+		ASSERT(top.size() == 10);
+		for (size_t i = 0; i < top.size(); i++)
+			ASSERT(top[i].count == counts[i].count && top[i].token.data() == counts[i].token.data());
+	}
+
+	{
+		std::string s;
+		cx::append_json_escaped(s, "plain text that is longer than thirty-two bytes \"quoted\" back\\slash\n\t\x01 caf\xC3\xA9");
+		ASSERT(s == "plain text that is longer than thirty-two bytes \\\"quoted\\\" back\\\\slash\\n\\t\\u0001 caf\xC3\xA9");
+		s.clear();
+		cx::append_json_escaped(s, cx::string_view("a\0b", 3));
+		ASSERT(s == "a\\u0000b");
+
+		s.clear();
+		cx::append_csv_quoted(s, "no quoting needed even for a field longer than 32 bytes");
+		s += ',';
+		cx::append_csv_quoted(s, "say \"hi\", then\nleave");
+		s += ',';
+		cx::append_csv_quoted(s, "a;b", ';');
+		ASSERT(s == "no quoting needed even for a field longer than 32 bytes,\"say \"\"hi\"\", then\nleave\",\"a;b\"");
+
+		char buffer[128];
+		ASSERT(*cx::append_csv_quoted(buffer, "x,y") == '\0' && std::string(buffer) == "\"x,y\"");
+		ASSERT(cx::append_json_escaped(buffer, "\"") == buffer + 2 && std::string(buffer) == "\\\"");
+		ASSERT(cx::format("{\"msg\":\"%J\",\"n\":%d}", "line1\nline2", 3) == "{\"msg\":\"line1\\nline2\",\"n\":3}");
+		ASSERT(std::string(cx::format_to_buffer(buffer, "%Q,%Q", "a", "b,c")) == "a,\"b,c\"");
+		ASSERT(cx::format("{\"m\":\"%J\",\"n\":%5d}", "a\"b", 3) == "{\"m\":\"a\\\"b\",\"n\":    3}");
+		ASSERT(cx::format("%J %e %-4s|%s", "x\ny", 1.5, "ab", "tail") == "x\\ny 1.500000e+00 ab  |tail");
+		ASSERT(cx::format("%*d,%.*f,%Q,%lld,%%J", 4, 7, 2, 0.125, "a\"", -5LL) == "   7,0.12,\"a\"\"\",-5,%J");
+		ASSERT(cx::format("%J%n%s", "a", (int*)NULL, "b") == "a");
+		ASSERT(std::string(cx::format_to_buffer(buffer, "%Q|%08.3f|%x", "p,q", -1.5, 255u)) == "\"p,q\"|-001.500|ff");
+		ASSERT(cx::format("%J:%600s", "z", "y").size() == 602);
+		ASSERT(cx::format("%.900f", 1.0) == "1." + std::string(900, '0'));
+		ASSERT(cx::format("%J %.900f", "a", 1.0) == "a 1." + std::string(900, '0'));
+		ASSERT(cx::format("%.600g|%.1000f", 0.5, -2.0) == "0.5|-2." + std::string(1000, '0'));
+		char wide[1024];
+		ASSERT(std::string(cx::format_to_buffer(wide, "%.700f", 0.25)) == "0.25" + std::string(698, '0'));
+	}
+
 	{
 		ASSERT(cx::format_to_buffer(NULL, "%s", "abc") == NULL);
 